@@ -1,6 +1,10 @@
 
 #include "master.h"
 #include "unistd.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <errno.h>
 
 // ====== Globals ======
 t_log*        g_logger = NULL;
@@ -8,22 +12,31 @@ t_master_cfg  g_cfg;
 int           g_server_fd = -1;
 uint32_t      g_next_qid = 0;
 
-t_queue*      g_ready = NULL;
+t_ready       g_ready;
 t_list*       g_workers = NULL;
-t_dictionary* g_queries = NULL;
+t_qtabla      g_queries;
 
-pthread_mutex_t m_ready   = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t m_workers = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t m_queries = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t  c_ready   = PTHREAD_COND_INITIALIZER;
 
 // ====== Config ======
 bool master_load_config(char* path){
     t_config* cfg = config_create(path);
     if(!cfg) return false;
     g_cfg.puerto_escucha = strdup(config_get_string_value(cfg,"PUERTO_ESCUCHA"));
-    g_cfg.algoritmo      = strdup(config_get_string_value(cfg,"ALGORITMO_PLANIFICACION")); // FIFO | PRIORIDADES
+    g_cfg.algoritmo      = strdup(config_get_string_value(cfg,"ALGORITMO_PLANIFICACION")); // FIFO | PRIORIDADES | RR | MLFQ
+    g_cfg.plani = strcmp(g_cfg.algoritmo,"PRIORIDADES")==0 ? PLANI_PRIORIDADES
+                : strcmp(g_cfg.algoritmo,"RR")==0          ? PLANI_RR
+                : strcmp(g_cfg.algoritmo,"MLFQ")==0        ? PLANI_MLFQ
+                : PLANI_FIFO;
+    // RR / MLFQ: desalojo por fin de quantum (el de MLFQ se duplica por nivel)
+    g_cfg.quantum_ms     = config_has_property(cfg,"QUANTUM") ? config_get_int_value(cfg,"QUANTUM") : 0;
+    g_cfg.niveles_mlfq   = config_has_property(cfg,"NIVELES_MLFQ") ? config_get_int_value(cfg,"NIVELES_MLFQ") : 3;
+    if(g_cfg.niveles_mlfq < 1) g_cfg.niveles_mlfq = 1;
+    if(g_cfg.niveles_mlfq > MLFQ_NIVELES_MAX) g_cfg.niveles_mlfq = MLFQ_NIVELES_MAX;
+    g_cfg.boost_mlfq_ms  = config_has_property(cfg,"BOOST_MLFQ") ? config_get_int_value(cfg,"BOOST_MLFQ") : 0;
     g_cfg.tiempo_aging_ms= config_get_int_value(cfg,"TIEMPO_AGING");
+    g_cfg.menos_cargado  = config_has_property(cfg,"SELECCION_WORKER")
+                        && strcmp(config_get_string_value(cfg,"SELECCION_WORKER"),"MENOS_CARGADO")==0;
+    g_cfg.timeout_worker_ms = config_has_property(cfg,"TIMEOUT_WORKER") ? config_get_int_value(cfg,"TIMEOUT_WORKER") : 0;
     t_log_level lvl      = config_get_int_value(cfg,"LOG_LEVEL");
     g_logger = log_create("master.log","MASTER",1, lvl);
     config_destroy(cfg);
@@ -44,179 +57,165 @@ static void sigint_handler(int _sig){
     exit(0);
 }
 
-// ====== Accept loop ======
-void* master_accept_loop(void* _arg){
-    (void)_arg;
-    for(;;){
-        int fd = esperar_cliente(g_server_fd);
-        if(fd < 0){ log_error(g_logger,"accept falló"); continue; }
-
-        int op = recibir_operacion(fd);
-        if(op <= 0){ close(fd); continue; }
-
-        pthread_t th;
-        if(op == HANDSHAKE_QC){
-            send_master_ack(fd);
-            pthread_create(&th,NULL,(void*(*)(void*))master_handle_qc,(void*)(intptr_t)fd);
-        } else if(op == HANDSHAKE_WORKER){
-            pthread_create(&th,NULL,(void*(*)(void*))master_handle_worker,(void*)(intptr_t)fd);
-        } else {
-            log_error(g_logger,"Handshake desconocido (%d)", op);
-            close(fd);
-            continue;
-        }
-        pthread_detach(th);
+// ====== Reactor ======
+// Un solo hilo con epoll atiende el accept y todos los sockets de QC y Workers.
+// Resuelve el handshake y le pasa cada mensaje completo (y cada cierre) al
+// planificador como evento; no toca Queries ni Workers. Los sockets de
+// clientes tienen cola de salida: el planificador nunca se bloquea mandando
+// y lo que no entró lo termina de mandar el reactor con EPOLLOUT.
+static int g_epfd = -1;
+
+static void conn_cerrar(t_master_conn* c){
+    epoll_ctl(g_epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    evento_publicar(c, EV_DESCONEXION, NULL); // el planificador cierra el fd y libera c
+}
+
+// false = cerrar la conexión; pkg queda consumido
+static bool conn_despachar(t_master_conn* c, int op, t_paquete* pkg){
+    if(c->tipo != CONN_HANDSHAKE){
+        evento_publicar(c, op, pkg);
+        return true;
     }
-    return NULL;
+    eliminar_paquete(pkg);
+    if(op == HANDSHAKE_QC){ c->tipo = CONN_QC; send_master_ack(c->fd); return true; }
+    if(op == HANDSHAKE_WORKER){ c->tipo = CONN_WORKER; return true; }
+    log_error(g_logger,"Handshake desconocido (%d)", op);
+    return false;
 }
 
-// master_sched.c
-static t_query* pop_ready_siguiente(void){
-    t_query* elegida = NULL;
+void* master_reactor_loop(void* _arg){
+    (void)_arg;
+    g_epfd = epoll_create1(0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL }; // NULL = socket de escucha
+    epoll_ctl(g_epfd, EPOLL_CTL_ADD, g_server_fd, &ev);
 
-    pthread_mutex_lock(&m_ready);
-    int n = queue_size(g_ready);
-    if(n == 0){ pthread_mutex_unlock(&m_ready); return NULL; }
+    struct epoll_event evs[64];
+    for(;;){
+        int n = epoll_wait(g_epfd, evs, 64, -1);
+        if(n < 0){ if(errno == EINTR) continue; log_error(g_logger,"epoll_wait falló"); break; }
+
+        for(int i=0;i<n;++i){
+            t_master_conn* c = evs[i].data.ptr;
+            if(!c){
+                int fd = esperar_cliente(g_server_fd);
+                if(fd < 0){ log_error(g_logger,"accept falló"); continue; }
+                c = calloc(1, sizeof(*c));
+                c->fd = fd; c->tipo = CONN_HANDSHAKE;
+                struct epoll_event cev = { .events = EPOLLIN, .data.ptr = c };
+                epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &cev);
+                conexion_vigilar_salida(conexion_de(fd), g_epfd, c);
+                continue;
+            }
 
-    if(strcmp(g_cfg.algoritmo, "PRIORIDADES") != 0){
-        // FIFO
-        elegida = queue_pop(g_ready);
-        pthread_mutex_unlock(&m_ready);
-        return elegida;
+            t_conexion* cx = conexion_de(c->fd);
+            if(evs[i].events & EPOLLOUT) conexion_vaciar_salida(cx);
+            if(!(evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) continue;
+            int r = conexion_leer_disponible(cx);
+            if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+            bool seguir = r > 0;
+            int op; t_paquete* pkg;
+            while(seguir && (pkg = conexion_extraer_paquete(cx, &op))){
+                seguir = conn_despachar(c, op, pkg);
+            }
+            if(seguir && cx->invalida){ log_error(g_logger,"Mensaje fuera de protocolo en el fd %d: se cierra", c->fd); seguir = false; }
+            if(!seguir) conn_cerrar(c);
+        }
     }
+    return NULL;
+}
 
-    // PRIORIDADES: buscamos la de menor prioridad numérica
-    t_list* tmp = list_create();
-    for(int i=0; i<n; ++i) list_add(tmp, queue_pop(g_ready));
-
-    int idx_best = 0;
-    uint32_t best = ((t_query*)list_get(tmp,0))->prioridad;
-    for(int i=1; i<list_size(tmp); ++i){
-        t_query* q = list_get(tmp,i);
-        if(q->prioridad < best){ best = q->prioridad; idx_best = i; }
+// ====== Planificador ======
+// Dueño único del estado: READY, tabla de Queries, Workers y las conexiones
+// que le llegan por eventos. Sin locks: procesa los eventos pendientes, avanza
+// el aging y asigna mientras haya algo en READY y capacidad para correrlo.
+static bool g_prioridades = false;
+
+static void procesar_evento(t_evento* e){
+    t_master_conn* c = e->c;
+    if(e->op == EV_DESCONEXION){
+        if(c->tipo == CONN_QC) master_qc_desconectado(c);
+        else if(c->tipo == CONN_WORKER) master_worker_desconectado(c);
+        liberar_conexion(c->fd); // recién ahora: nadie más le envía
+        free(c);
+        return;
     }
-    elegida = list_remove(tmp, idx_best);      // saco la mejor
-    // devuelvo el resto a READY en el mismo orden
-    for(int i=0; i<list_size(tmp); ++i) queue_push(g_ready, list_get(tmp,i));
-    list_destroy(tmp);
-    pthread_mutex_unlock(&m_ready);
-    return elegida;
+    bool ok = c->tipo == CONN_QC ? master_handle_qc(c, e->op, e->pkg)
+                                 : master_handle_worker(c, e->op, e->pkg);
+    eliminar_paquete(e->pkg);
+    if(!ok) shutdown(c->fd, SHUT_RDWR); // el reactor ve el cierre y lo avisa
 }
 
-// ====== Scheduler loop (FIFO inicial) ======
- void* master_scheduler_loop(void* _arg){
-     (void)_arg;
-     for(;;){
-         pthread_mutex_lock(&m_ready);
-         while(queue_is_empty(g_ready)){
-             pthread_cond_wait(&c_ready, &m_ready);
-         }
-         t_query* q = pop_ready_siguiente();
-         pthread_mutex_unlock(&m_ready);
-
-         // buscar un Worker libre
-         pthread_mutex_lock(&m_workers);
-         t_worker* w = NULL;
-         for(int i=0;i<list_size(g_workers);++i){
-             t_worker* cand = list_get(g_workers,i);
-             if(!cand->ocupado){ w=cand; break; }
-         }
-         pthread_mutex_unlock(&m_workers);
-
-        if(!w){
-            // Sin worker libre: si algoritmo = PRIORIDADES, intentamos DESALOJAR
-            if(strcmp(g_cfg.algoritmo, "PRIORIDADES") == 0){
-                uint32_t prio_in = q->prioridad;
-                t_worker* vict = NULL;
-                t_query*  vict_q = NULL;
-                uint32_t  worst = 0; // rastreamos la peor prioridad (mayor número)
-
-                pthread_mutex_lock(&m_workers);
-                for(int i=0;i<list_size(g_workers);++i){
-                    t_worker* cw = list_get(g_workers,i);
-                    if(!cw->ocupado) continue;
-                    // buscar query en ejecución de este worker
-                    pthread_mutex_lock(&m_queries);
-                    char* key = string_itoa(cw->running_qid);
-                    t_query* running = dictionary_get(g_queries, key);
-                    free(key);
-                    pthread_mutex_unlock(&m_queries);
-                    if(!running) continue;
-                    if(running->prioridad > prio_in && running->prioridad >= worst){
-                        worst = running->prioridad;
-                        vict = cw;
-                        vict_q = running;
-                    }
-                }
-                pthread_mutex_unlock(&m_workers);
-
-                if(vict && vict_q){
-                    // Desalojamos la peor y dejamos q pendiente en ese worker
-                    send_master_desalojar(vict->fd, vict_q->id);
-                    log_desalojo_por_prioridad(vict_q->id, vict_q->prioridad, q->id, q->prioridad, vict->id);
-                    // marcaremos la q desalojada como READY cuando llegue WORKER_DEVOLVER_PC
-                    pthread_mutex_lock(&m_workers);
-                    vict->next_q = q; // asignar esta apenas devuelva PC
-                    pthread_mutex_unlock(&m_workers);
-                    // no reencolamos q: quedará “pendiente” en el worker víctima
-                    continue;
-                }
-            }
-            // Si no hubo desalojo posible, reencolamos
-            master_enqueue_ready(q);
-            usleep(50*1000);
+static void despachar(void){
+    t_query* q;
+    while((q = ready_peek(&g_ready))){
+        // la de mayor prioridad (o la más vieja en FIFO); queda en READY
+        // hasta que haya dónde correrla
+        t_slot* s = g_cfg.menos_cargado ? workers_libre_menos_cargado() : afinidad_elegir(q);
+        if(s){
+            ready_pop(&g_ready);
+            q->estado = Q_EXEC;
+            q->worker_fd = s->w->fd;
+            workers_ejecutando(s, q);
+            send_master_asignar_query(s->w->fd, q->id, q->pc, q->path);
+            log_envio_q_a_worker(q->id, s->w->id);
+            query_unref(q); // en EXEC la sigue la tabla (running_qid del slot)
             continue;
         }
+        t_slot* vict = g_prioridades ? workers_victima(q->prioridad) : NULL;
+        if(!vict) break;
+        // Desalojamos la peor; la desalojada vuelve a READY cuando llegue
+        // WORKER_DEVOLVER_PC y q se asigna en ese slot (se lleva la referencia de READY)
+        ready_pop(&g_ready);
+        uint32_t vict_qid = vict->running_qid, vict_prio = vict->running_prio;
+        workers_reservar_desalojo(vict, q);
+        send_master_desalojar(vict->w->fd, vict_qid);
+        log_desalojo_por_prioridad(vict_qid, vict_prio, q->id, q->prioridad, vict->w->id);
+    }
+}
 
-         // asignar
-         q->estado = Q_EXEC;
-         q->worker_fd = w->fd;
-         w->ocupado = true; w->running_qid = q->id;
-
-         send_master_asignar_query(w->fd, q->id, q->pc, q->path);
-         log_envio_q_a_worker(q->id, w->id);
-     }
-     return NULL;
- }
-// ====== Aging loop (opcional) ======
-void* master_aging_loop(void* _arg){
-    (void)_arg;
-    if(g_cfg.tiempo_aging_ms <= 0) return NULL;
+// Fin de quantum: si quedó alguien en READY (ya se despachó, así que no hay
+// slot libre) se desaloja con DESALOJAR y al volver el PC la Query va al final
+// de READY; si no, sigue con otro quantum. Con MLFQ agotar el quantum la baja
+// un nivel en cualquier caso.
+static void vencer_quantums(uint64_t ahora){
+    mlfq_boost(ahora);
+    t_slot* s;
+    while((s = quantum_vencido(ahora))){
+        t_query* q = master_query_get(s->running_qid);
+        if(!q || s->desalojando) continue; // ya viene su FIN / DEVOLVER_PC
+        if(g_cfg.plani == PLANI_MLFQ && q->nivel + 1 < (uint32_t)g_cfg.niveles_mlfq) q->nivel++;
+        if(!ready_peek(&g_ready)){ quantum_iniciar(s, q->nivel); continue; }
+        s->desalojando = true;
+        send_master_desalojar(s->w->fd, q->id);
+        log_desalojo_por_quantum(q->id, s->w->id, q->nivel);
+    }
+}
 
+void* master_scheduler_loop(void* _arg){
+    (void)_arg;
+    g_prioridades = g_cfg.plani == PLANI_PRIORIDADES;
+    struct pollfd p = { .fd = g_ev_fd, .events = POLLIN };
+    int vigilancia = g_cfg.timeout_worker_ms > 0 ? (g_cfg.timeout_worker_ms + 3) / 4 : 0;
     for(;;){
-        usleep(100 * 1000); // 100ms de granularidad
-
-        pthread_mutex_lock(&m_ready);
-        int n = queue_size(g_ready);
-        bool hubo_cambios = false;
-
-        // volcamos la cola a una lista temporal, actualizamos y reconstruimos
-        t_list* tmp = list_create();
-        for(int i=0; i<n; ++i){
-            t_query* q = queue_pop(g_ready);
-            uint64_t elapsed = now_ms() - q->last_aging_ms;
-
-            if(elapsed >= (uint64_t)g_cfg.tiempo_aging_ms){
-                uint32_t prev = q->prioridad;
-                // cuántos “saltos” de aging le corresponden por el tiempo acumulado
-                uint64_t steps = elapsed / (uint64_t)g_cfg.tiempo_aging_ms;
-                if(q->prioridad > steps) q->prioridad -= (uint32_t)steps;
-                else q->prioridad = 0;
-
-                q->last_aging_ms += steps * (uint64_t)g_cfg.tiempo_aging_ms;
-                if(q->prioridad != prev){
-                    log_cambio_prioridad(q->id, prev, q->prioridad);
-                    hubo_cambios = true;
-                }
-            }
-            list_add(tmp, q);
+        // con Queries por agear se despierta en cada tick de la rueda; si se
+        // vigilan Workers, al menos cuatro veces por TIMEOUT_WORKER
+        int espera = aging_activo() ? AGING_TICK_MS : -1;
+        if(vigilancia > 0 && list_size(g_workers) > 0 && (espera < 0 || vigilancia < espera)) espera = vigilancia;
+        int q_espera = quantum_espera_ms(now_ms());
+        if(q_espera >= 0 && (espera < 0 || q_espera < espera)) espera = q_espera;
+        int r = poll(&p, 1, espera);
+        if(r < 0 && errno != EINTR){ log_error(g_logger,"poll del planificador falló"); break; }
+
+        eventos_vaciar_aviso();
+        t_evento* e;
+        while((e = evento_tomar())){
+            procesar_evento(e);
+            free(e);
         }
-        // reconstruimos la cola READY (sin necesidad de ordenar aquí)
-        for(int i=0; i<list_size(tmp); ++i) queue_push(g_ready, list_get(tmp, i));
-        list_destroy(tmp);
-        pthread_mutex_unlock(&m_ready);
-
-        if(hubo_cambios) pthread_cond_signal(&c_ready); // despertá al planificador
+        if(g_cfg.tiempo_aging_ms > 0) aging_avanzar(now_ms());
+        if(vigilancia > 0) workers_vigilar(now_ms());
+        despachar();
+        if(quantum_activo()) vencer_quantums(now_ms());
     }
     return NULL;
 }
@@ -228,25 +227,23 @@ int main(int argc, char** argv){
 
     signal(SIGINT, sigint_handler);
 
-    g_ready   = queue_create();
+    ready_crear(&g_ready, g_cfg.plani == PLANI_PRIORIDADES ? ORDEN_PRIORIDAD
+                        : g_cfg.plani == PLANI_MLFQ ? ORDEN_NIVEL : ORDEN_LLEGADA);
     g_workers = list_create();
-    g_queries = dictionary_create();
+    qtabla_crear(&g_queries, 64);
 
     g_server_fd = iniciar_servidor(g_cfg.puerto_escucha);
     if(g_server_fd < 0){ log_error(g_logger,"No pude iniciar servidor en %s", g_cfg.puerto_escucha); return EXIT_FAILURE; }
     log_info(g_logger,"Master escuchando en puerto %s", g_cfg.puerto_escucha);
 
-    pthread_t th_accept, th_sched, th_aging;
-    pthread_create(&th_accept, NULL, master_accept_loop, NULL);
+    if(!eventos_iniciar()){ log_error(g_logger,"No pude crear el eventfd del planificador"); return EXIT_FAILURE; }
+
+    pthread_t th_reactor, th_sched;
+    pthread_create(&th_reactor, NULL, master_reactor_loop, NULL);
     pthread_create(&th_sched,  NULL, master_scheduler_loop, NULL);
-    pthread_detach(th_accept);
+    pthread_detach(th_reactor);
     pthread_detach(th_sched);
 
-    if(g_cfg.tiempo_aging_ms > 0){
-        pthread_create(&th_aging, NULL, master_aging_loop, NULL); // Aging READY periódicamente. :contentReference[oaicite:7]{index=7}
-        pthread_detach(th_aging);
-    }
-
     // dormir el main para siempre
     for(;;) pause();
     return 0;
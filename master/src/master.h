@@ -8,10 +8,10 @@
 #include <commons/collections/list.h>
 #include <commons/collections/queue.h>
 #include <arpa/inet.h>
-#include <commons/collections/dictionary.h>
 #include <../../utils/src/utils/conexiones.h>
 #include <../../utils/src/utils/protocolos.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -23,7 +23,7 @@
 typedef enum { Q_NEW, Q_READY, Q_EXEC, Q_EXIT } qstate_t;
 
 // ===== Estructuras =====
-typedef struct {
+typedef struct t_query_s {
     uint32_t id;
     char*    path;        // path del archivo de Query
     uint32_t prioridad;   // 0 = mayor prioridad
@@ -32,22 +32,98 @@ typedef struct {
     int      worker_fd;   // socket del Worker (si está en EXEC)
     uint64_t last_aging_ms;   // último instante en que se ageó / (re)encoló en READY
     qstate_t estado;
+    int      refs;        // ver query_ref/query_unref (master_queries.c)
+    int      ready_idx;   // posición en el heap READY (-1 si no está)
+    uint64_t llegada;     // orden de llegada a READY (desempate)
+    uint64_t clave;       // orden en READY, fija mientras está encolada
+    uint32_t nivel;       // MLFQ: cola en la que está (0 = la de quantum más corto)
+    uint64_t aging_vence; // próximo instante en que baja la prioridad
+    int      aging_slot;  // slot de la rueda de aging (-1 si no está)
+    struct t_query_s *aging_sig, *aging_ant;
 } t_query;
 
- typedef struct {
-    uint32_t id;
-    int      fd;
-    bool     ocupado;
+// ===== Tabla de Queries: qid -> t_query* (direccionamiento abierto) =====
+typedef struct {
+    uint32_t qid;
+    t_query* q;           // NULL = slot libre
+} t_qslot;
+typedef struct {
+    t_qslot* slots;
+    uint32_t cap;         // potencia de 2
+    uint32_t n;
+} t_qtabla;
+
+ typedef struct t_slot_s {
+    struct t_worker_s* w;
     uint32_t running_qid; // 0xFFFFFFFF si libre
+    uint32_t running_prio; // prioridad con la que se asignó running_qid
     t_query* next_q; // si se desalojó otro para correr esta, se asigna apenas llega DEVOLVER_PC
+    int      run_idx;     // posición en el heap de ejecución (-1 si no está)
+    uint32_t pc_reportado; // PC de running_qid en el último WORKER_STATUS
+    uint64_t progreso_ms;  // última vez que running_qid avanzó
+    // quantum (RR / MLFQ, master_quantum.c)
+    uint64_t q_vence;
+    int      q_nivel;     // lista de vencimientos en la que está (-1 si no está)
+    struct t_slot_s *q_sig, *q_ant;
+    bool     desalojando; // ya se le pidió DESALOJAR por fin de quantum
+ } t_slot;
+
+ typedef struct t_worker_s {
+    uint32_t id;
+    int      fd;
+    int      slots;       // Queries en paralelo que anunció (WORKER_IDENTIFICACION)
+    int      ocupados;    // slots con una Query asignada
+    t_slot*  slot;
+    // índices de master_workers.c
+    struct t_worker_s *libre_sig, *libre_ant;
+    bool     en_libres;   // le queda algún slot libre
+    uint8_t  resumen[RESUMEN_CACHE_BYTES]; // File:Tags en su memoria (último WORKER_RESUMEN_CACHE)
+    // último WORKER_STATUS
+    uint64_t estado_ms;   // cuándo llegó (0 = nunca mandó: no se lo vigila)
+    uint32_t frames, frames_ocupados, dirty;
+    uint32_t miss_permil; // fallos cada mil accesos en el último intervalo
+    bool     trabado;     // alguna Query sin progreso: no recibe nuevas
+    bool     caido;       // sin latido: ya se le cerró la conexión
  } t_worker;
 
+// ===== Cola READY: heap binario indexado (master_ready.c) =====
+typedef enum { ORDEN_LLEGADA, ORDEN_PRIORIDAD, ORDEN_NIVEL } t_orden_ready;
+typedef struct {
+    t_query**    v;
+    int          n, cap;
+    t_orden_ready orden; // LLEGADA = FIFO/RR, NIVEL = MLFQ
+} t_ready;
+
+// ===== Conexiones (las maneja el reactor) =====
+typedef enum { CONN_HANDSHAKE, CONN_QC, CONN_WORKER } t_conn_tipo;
+typedef struct {
+    int         fd;
+    t_conn_tipo tipo;
+    t_query*    q;     // QC: su Query (NULL hasta QC_ENVIAR_QUERY)
+    t_worker*   w;     // Worker: NULL hasta WORKER_IDENTIFICACION
+} t_master_conn;
+
+// ===== Eventos reactor -> planificador (master_eventos.c) =====
+#define EV_DESCONEXION (-1) // op de un evento: la conexión se cerró
+typedef struct t_evento_s {
+    struct t_evento_s* _Atomic sig;
+    t_master_conn* c;
+    int            op;
+    t_paquete*     pkg;
+} t_evento;
 
 // ===== Config =====
+typedef enum { PLANI_FIFO, PLANI_PRIORIDADES, PLANI_RR, PLANI_MLFQ } t_planificacion;
 typedef struct {
     char* puerto_escucha;
-    char* algoritmo;      // "FIFO" | "PRIORIDADES"
+    char* algoritmo;      // "FIFO" | "PRIORIDADES" | "RR" | "MLFQ"
+    t_planificacion plani;
+    int   quantum_ms;     // RR: quantum; MLFQ: el del nivel 0 (se duplica por nivel)
+    int   niveles_mlfq;
+    int   boost_mlfq_ms;  // MLFQ: cada cuánto vuelven todas al nivel 0 (0 = nunca)
     int   tiempo_aging_ms; // 0 = sin aging
+    bool  menos_cargado;   // SELECCION_WORKER: AFINIDAD (default) | MENOS_CARGADO
+    int   timeout_worker_ms; // sin latido/progreso por más que esto = caído/trabado (0 = no se vigila)
     t_log_level log_level;
 } t_master_cfg;
 
@@ -58,38 +134,94 @@ extern t_master_cfg  g_cfg;
 extern int           g_server_fd;
 extern uint32_t      g_next_qid;
 
-extern t_queue*      g_ready;        // cola READY
+// Estado del planificador: sólo lo toca su hilo (ver master_scheduler_loop)
+extern t_ready       g_ready;        // cola READY
 extern t_list*       g_workers;      // lista de t_worker*
-extern t_dictionary* g_queries;      // qid -> t_query*
+extern t_qtabla      g_queries;      // qid -> t_query* (sólo Queries vivas)
 
-extern pthread_mutex_t m_ready;
-extern pthread_mutex_t m_workers;
-extern pthread_mutex_t m_queries;
-extern pthread_cond_t  c_ready;      // para despertar planificador
+extern int           g_ev_fd;        // eventfd: hay eventos para el planificador
 
 // ======= API =======
 bool master_load_config(char* path);
 void master_free_config(void);
 
-void* master_accept_loop(void* arg);
+void* master_reactor_loop(void* arg);
 void* master_scheduler_loop(void* arg);
-void* master_aging_loop(void* arg); // opcional
-
-// Handlers
-void master_handle_qc(int fd);
-void master_handle_worker(int fd);
+#define AGING_TICK_MS 10
+bool  aging_activo(void);
+void  aging_avanzar(uint64_t ahora);
+void  aging_agendar(t_query* q);
+void  aging_cancelar(t_query* q);
+
+bool      eventos_iniciar(void);
+void      evento_publicar(t_master_conn* c, int op, t_paquete* pkg);
+t_evento* evento_tomar(void);
+void      eventos_vaciar_aviso(void);
+
+// Handlers (hilo planificador): reciben un mensaje ya completo; false = cerrar la conexión
+bool master_handle_qc(t_master_conn* c, int op, t_paquete* pkg);
+void master_qc_desconectado(t_master_conn* c);
+bool master_handle_worker(t_master_conn* c, int op, t_paquete* pkg);
+void master_worker_desconectado(t_master_conn* c);
+
+// Tabla de Queries y ciclo de vida
+void     qtabla_crear(t_qtabla* t, uint32_t cap);
+void     qtabla_destruir(t_qtabla* t);
+t_query* qtabla_get(t_qtabla* t, uint32_t qid);
+void     qtabla_put(t_qtabla* t, t_query* q);
+t_query* qtabla_remove(t_qtabla* t, uint32_t qid);
+
+t_query* query_crear(char* path, uint32_t prioridad, int qc_fd);
+void     query_ref(t_query* q);
+void     query_unref(t_query* q);
+t_query* master_query_get(uint32_t qid);
+void     master_query_finalizar(t_query* q);
+
+// Cola READY
+void     ready_crear(t_ready* r, t_orden_ready orden);
+void     ready_destruir(t_ready* r);
+void     ready_push(t_ready* r, t_query* q);
+t_query* ready_peek(t_ready* r);
+t_query* ready_pop(t_ready* r);
+void     ready_quitar(t_ready* r, t_query* q);
+void     ready_reordenar(t_ready* r);
+
+// Quantum (RR / MLFQ)
+#define MLFQ_NIVELES_MAX 16
+bool     quantum_activo(void);
+void     quantum_iniciar(t_slot* s, uint32_t nivel);
+void     quantum_cancelar(t_slot* s);
+int      quantum_espera_ms(uint64_t ahora);
+t_slot*  quantum_vencido(uint64_t ahora);
+void     mlfq_boost(uint64_t ahora);
+
+// Workers con slots libres / slots en ejecución
+void      workers_alta(t_worker* w);
+void      workers_baja(t_worker* w);
+t_slot*   workers_slot_de(t_worker* w, uint32_t qid);
+void      workers_libre(t_slot* s);
+void      workers_ejecutando(t_slot* s, t_query* q);
+void      workers_reservar_desalojo(t_slot* s, t_query* nq);
+t_slot*   workers_libre_primero(void);
+t_slot*   workers_libre_con_afinidad(const uint32_t* hashes, int n);
+t_slot*   workers_libre_menos_cargado(void);
+void      workers_progreso(t_slot* s);
+void      workers_revisar_trabado(t_worker* w);
+void      workers_vigilar(uint64_t ahora);
+t_slot*   workers_victima(uint32_t prio);
+int       workers_slots_total(void);
+
+// Afinidad de caché (path de Query -> File:Tags que usa)
+void      afinidad_aprender(const char* path, const uint32_t* hashes, int n);
+t_slot*   afinidad_elegir(t_query* q);
 
 // Utilidades
 void master_enqueue_ready(t_query* q);
-void master_assign_next_if_possible(void);
 int  master_count_workers(void);
-t_worker* master_pick_idle_worker(void);
-t_query* master_pop_next_ready_fifo(void);
 uint64_t now_ms(void);
 
 // Protocolo
 void send_master_ack(int fd);
-void send_master_lectura(int qc_fd, const char* file_tag, const char* contenido);
 void send_master_fin(int qc_fd, const char* motivo);
 void send_master_asignar_query(int worker_fd, uint32_t qid, uint32_t pc_inicial, const char* path);
 void send_master_desalojar(int worker_fd, uint32_t qid);
@@ -104,6 +236,7 @@ void log_envio_lectura_a_qc(uint32_t qid, uint32_t worker_id);
 void log_fin_query_en_worker(uint32_t qid, uint32_t worker_id);
 void log_desalojo_por_prioridad(uint32_t qid_out, uint32_t prio_out, uint32_t qid_in, uint32_t prio_in, uint32_t worker_id);
 void log_desalojo_por_desconexion(uint32_t qid, uint32_t worker_id);
+void log_desalojo_por_quantum(uint32_t qid, uint32_t worker_id, uint32_t nivel);
 void log_cambio_prioridad(uint32_t qid, uint32_t prio_old, uint32_t prio_new);
 
 #endif
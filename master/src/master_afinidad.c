@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <string.h>
+#include <commons/collections/dictionary.h>
+#include "master.h"
+
+// ====== Afinidad de caché ======
+// Por cada path de Query se recuerdan los File:Tags (su hash) que usaron sus
+// corridas anteriores, según WORKER_ARCHIVOS_QUERY. Al despachar, entre los
+// Workers con lugar se prefiere el que más de ellos tenga en su resumen de
+// caché (WORKER_RESUMEN_CACHE). Sólo la usa el planificador.
+
+typedef struct {
+    uint32_t h[HUELLA_MAX_ARCHIVOS];
+    int      n;
+} t_huella;
+
+static t_dictionary* g_huellas = NULL; // path -> t_huella*
+
+// Une lo que usó una corrida con lo ya conocido (una corrida desalojada
+// reporta sólo lo que llegó a tocar)
+void afinidad_aprender(const char* path, const uint32_t* hashes, int n){
+    if(!g_huellas) g_huellas = dictionary_create();
+    t_huella* hu = dictionary_get(g_huellas, (char*)path);
+    if(!hu){
+        hu = calloc(1, sizeof(*hu));
+        dictionary_put(g_huellas, (char*)path, hu);
+    }
+    for(int i=0;i<n;++i){
+        bool esta = false;
+        for(int j=0;j<hu->n && !esta;++j) esta = hu->h[j] == hashes[i];
+        if(!esta && hu->n < HUELLA_MAX_ARCHIVOS) hu->h[hu->n++] = hashes[i];
+    }
+}
+
+// Slot libre para q: el del Worker con más File:Tags de q en memoria, o el
+// primero con lugar si no se sabe nada de su path
+t_slot* afinidad_elegir(t_query* q){
+    t_huella* hu = g_huellas ? dictionary_get(g_huellas, q->path) : NULL;
+    if(!hu || hu->n == 0) return workers_libre_primero();
+    return workers_libre_con_afinidad(hu->h, hu->n);
+}
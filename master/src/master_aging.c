@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include "master.h"
+
+// ====== Aging perezoso ======
+// El orden de READY no se recalcula: con PRIORIDADES el heap usa la clave
+// fija prioridad*TIEMPO_AGING + instante de encolado, que ordena igual que
+// la prioridad efectiva (prioridad - transcurrido/TIEMPO_AGING).
+// q->prioridad sólo se baja para que el valor visible (logs, desalojo) siga
+// al tiempo; eso lo hace una rueda de timers que toca nada más las Queries
+// que vencen en cada tick, sin recorrer la cola. La avanza el planificador.
+
+#define RUEDA_SLOTS   512
+
+static t_query* g_rueda[RUEDA_SLOTS]; // listas intrusivas (aging_sig/aging_ant)
+static uint64_t g_rueda_tick = 0;     // último tick procesado
+static int      g_rueda_n = 0;        // Queries agendadas
+
+void aging_agendar(t_query* q){
+    if(g_cfg.tiempo_aging_ms <= 0 || q->prioridad == 0) return;
+    q->aging_vence = q->last_aging_ms + (uint64_t)g_cfg.tiempo_aging_ms;
+    uint64_t tick = q->aging_vence / AGING_TICK_MS;
+    if(tick <= g_rueda_tick) tick = g_rueda_tick + 1;
+    int slot = (int)(tick % RUEDA_SLOTS);
+    q->aging_slot = slot;
+    q->aging_ant = NULL;
+    q->aging_sig = g_rueda[slot];
+    if(g_rueda[slot]) g_rueda[slot]->aging_ant = q;
+    g_rueda[slot] = q;
+    g_rueda_n++;
+}
+
+void aging_cancelar(t_query* q){
+    if(q->aging_slot < 0) return;
+    if(q->aging_ant) q->aging_ant->aging_sig = q->aging_sig;
+    else g_rueda[q->aging_slot] = q->aging_sig;
+    if(q->aging_sig) q->aging_sig->aging_ant = q->aging_ant;
+    q->aging_sig = q->aging_ant = NULL;
+    q->aging_slot = -1;
+    g_rueda_n--;
+}
+
+// Vence un slot: baja un punto a cada Query cuyo instante ya pasó y la
+// vuelve a agendar para el siguiente; las de vueltas futuras se saltean.
+static void vencer_slot(int slot, uint64_t ahora){
+    t_query* q = g_rueda[slot];
+    while(q){
+        t_query* sig = q->aging_sig;
+        if(q->aging_vence <= ahora){
+            aging_cancelar(q);
+            uint32_t prev = q->prioridad;
+            q->prioridad--;
+            q->last_aging_ms = q->aging_vence;
+            log_cambio_prioridad(q->id, prev, q->prioridad);
+            aging_agendar(q);
+        }
+        q = sig;
+    }
+}
+
+bool aging_activo(void){
+    return g_rueda_n > 0;
+}
+
+// Procesa los ticks vencidos desde la última llamada
+void aging_avanzar(uint64_t ahora){
+    uint64_t hasta = ahora / AGING_TICK_MS;
+    uint64_t desde = g_rueda_tick + 1;
+    // si pasó más de una vuelta, alcanza con recorrer cada slot una vez
+    if(hasta >= RUEDA_SLOTS && desde < hasta - RUEDA_SLOTS + 1) desde = hasta - RUEDA_SLOTS + 1;
+    for(uint64_t t = desde; t <= hasta; ++t){
+        g_rueda_tick = t;
+        vencer_slot((int)(t % RUEDA_SLOTS), ahora);
+    }
+}
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include "master.h"
+
+// ====== Eventos hacia el planificador ======
+// Cola MPSC intrusiva sin locks (Vyukov): cada productor se engancha con un
+// exchange sobre la cola y recién después enlaza al anterior; el único
+// consumidor (el planificador) avanza por la cabeza. Un nodo stub evita que
+// la cola quede vacía. El eventfd despierta al planificador y se escribe
+// después de enlazar, así un consumidor que vio un enlace a medio hacer
+// vuelve a despertarse.
+
+static t_evento           g_stub;
+static t_evento* _Atomic  g_cola = &g_stub;  // último publicado (productores)
+static t_evento*          g_cabeza = &g_stub; // próximo a consumir (planificador)
+int g_ev_fd = -1;
+
+bool eventos_iniciar(void){
+    atomic_store(&g_stub.sig, NULL);
+    g_ev_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return g_ev_fd >= 0;
+}
+
+static void enganchar(t_evento* e){
+    atomic_store_explicit(&e->sig, NULL, memory_order_relaxed);
+    t_evento* prev = atomic_exchange_explicit(&g_cola, e, memory_order_acq_rel);
+    atomic_store_explicit(&prev->sig, e, memory_order_release);
+}
+
+// pkg pasa a ser del planificador (NULL en EV_DESCONEXION)
+void evento_publicar(t_master_conn* c, int op, t_paquete* pkg){
+    t_evento* e = malloc(sizeof(*e));
+    e->c = c; e->op = op; e->pkg = pkg;
+    enganchar(e);
+    uint64_t uno = 1;
+    while(write(g_ev_fd, &uno, sizeof(uno)) < 0 && errno == EINTR);
+}
+
+// Sólo el planificador. NULL si no hay (o si un productor está a mitad de
+// publicar: su write al eventfd lo vuelve a despertar).
+t_evento* evento_tomar(void){
+    t_evento* cabeza = g_cabeza;
+    t_evento* sig = atomic_load_explicit(&cabeza->sig, memory_order_acquire);
+    if(cabeza == &g_stub){
+        if(!sig) return NULL;
+        g_cabeza = cabeza = sig;
+        sig = atomic_load_explicit(&sig->sig, memory_order_acquire);
+    }
+    if(sig){ g_cabeza = sig; return cabeza; }
+    if(cabeza != atomic_load_explicit(&g_cola, memory_order_acquire)) return NULL;
+    // cabeza es el último: se reengancha el stub detrás para poder soltarla
+    enganchar(&g_stub);
+    sig = atomic_load_explicit(&cabeza->sig, memory_order_acquire);
+    if(sig){ g_cabeza = sig; return cabeza; }
+    return NULL;
+}
+
+void eventos_vaciar_aviso(void){
+    uint64_t v;
+    while(read(g_ev_fd, &v, sizeof(v)) > 0);
+}
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include "master.h"
+
+// ====== Quantum (RR / MLFQ) ======
+// Cada slot en ejecución tiene un vencimiento. Todos los del mismo nivel
+// usan el mismo quantum, así que en una lista por nivel los vencimientos
+// quedan en orden de inserción: agregar, quitar y ver el próximo es O(1)
+// (el próximo global es el menor de las cabezas). Con RR hay un solo nivel.
+// Sólo lo usa el planificador.
+
+static t_slot*  g_cab[MLFQ_NIVELES_MAX];
+static t_slot*  g_fin[MLFQ_NIVELES_MAX];
+static uint64_t g_ultimo_boost = 0;
+
+bool quantum_activo(void){
+    return (g_cfg.plani == PLANI_RR || g_cfg.plani == PLANI_MLFQ) && g_cfg.quantum_ms > 0;
+}
+
+static int niveles(void){
+    return g_cfg.plani == PLANI_MLFQ ? g_cfg.niveles_mlfq : 1;
+}
+
+// MLFQ: el quantum se duplica en cada nivel
+static uint64_t quantum_de(int nivel){
+    return (uint64_t)g_cfg.quantum_ms << nivel;
+}
+
+void quantum_iniciar(t_slot* s, uint32_t nivel){
+    if(!quantum_activo()) return;
+    quantum_cancelar(s);
+    int l = (int)nivel < niveles() ? (int)nivel : niveles() - 1;
+    s->q_vence = now_ms() + quantum_de(l);
+    s->q_nivel = l;
+    s->q_sig = NULL;
+    s->q_ant = g_fin[l];
+    if(g_fin[l]) g_fin[l]->q_sig = s;
+    else g_cab[l] = s;
+    g_fin[l] = s;
+}
+
+void quantum_cancelar(t_slot* s){
+    int l = s->q_nivel;
+    if(l < 0) return;
+    if(s->q_ant) s->q_ant->q_sig = s->q_sig;
+    else g_cab[l] = s->q_sig;
+    if(s->q_sig) s->q_sig->q_ant = s->q_ant;
+    else g_fin[l] = s->q_ant;
+    s->q_sig = s->q_ant = NULL;
+    s->q_nivel = -1;
+}
+
+static t_slot* proximo(void){
+    t_slot* p = NULL;
+    for(int l=0;l<niveles();++l)
+        if(g_cab[l] && (!p || g_cab[l]->q_vence < p->q_vence)) p = g_cab[l];
+    return p;
+}
+
+// ms hasta el próximo vencimiento (de quantum o de boost); -1 si no hay
+int quantum_espera_ms(uint64_t ahora){
+    if(!quantum_activo()) return -1;
+    uint64_t hasta = UINT64_MAX;
+    t_slot* p = proximo();
+    if(p) hasta = p->q_vence;
+    if(g_cfg.plani == PLANI_MLFQ && g_cfg.boost_mlfq_ms > 0 && g_queries.n > 0){
+        uint64_t b = g_ultimo_boost + (uint64_t)g_cfg.boost_mlfq_ms;
+        if(b < hasta) hasta = b;
+    }
+    if(hasta == UINT64_MAX) return -1;
+    return hasta <= ahora ? 0 : (int)(hasta - ahora);
+}
+
+// Saca y devuelve un slot con el quantum vencido (NULL si no hay)
+t_slot* quantum_vencido(uint64_t ahora){
+    t_slot* p = proximo();
+    if(!p || p->q_vence > ahora) return NULL;
+    quantum_cancelar(p);
+    return p;
+}
+
+// MLFQ: cada BOOST_MLFQ ms todas las Queries vuelven al nivel 0, así las que
+// bajaron por largas no se quedan sin CPU detrás de las cortas
+void mlfq_boost(uint64_t ahora){
+    if(g_cfg.plani != PLANI_MLFQ || g_cfg.boost_mlfq_ms <= 0) return;
+    if(g_ultimo_boost == 0) g_ultimo_boost = ahora;
+    if(ahora - g_ultimo_boost < (uint64_t)g_cfg.boost_mlfq_ms) return;
+    g_ultimo_boost = ahora;
+    for(uint32_t i=0;i<g_queries.cap;++i)
+        if(g_queries.slots[i].q) g_queries.slots[i].q->nivel = 0;
+    ready_reordenar(&g_ready);
+}
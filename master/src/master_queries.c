@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include "master.h"
+
+// ====== Tabla de Queries ======
+// Direccionamiento abierto con sondeo lineal, clave = qid (sin strings).
+// Capacidad potencia de 2; se duplica al pasar el 70% de ocupación y el
+// borrado corre hacia atrás los elementos del mismo cluster (sin lápidas).
+
+static uint32_t qtabla_hash(uint32_t qid, uint32_t mask){
+    return (qid * 2654435761u) & mask; // hash multiplicativo de Knuth
+}
+
+void qtabla_crear(t_qtabla* t, uint32_t cap){
+    uint32_t c = 16;
+    while(c < cap) c <<= 1;
+    t->slots = calloc(c, sizeof(t_qslot));
+    t->cap = c;
+    t->n = 0;
+}
+
+void qtabla_destruir(t_qtabla* t){
+    free(t->slots);
+    t->slots = NULL; t->cap = t->n = 0;
+}
+
+static t_qslot* qtabla_buscar(t_qtabla* t, uint32_t qid){
+    uint32_t mask = t->cap - 1;
+    for(uint32_t i = qtabla_hash(qid, mask);; i = (i + 1) & mask){
+        t_qslot* s = &t->slots[i];
+        if(!s->q || s->qid == qid) return s;
+    }
+}
+
+static void qtabla_crecer(t_qtabla* t){
+    t_qslot* viejos = t->slots;
+    uint32_t cap = t->cap;
+    t->slots = calloc((size_t)cap * 2, sizeof(t_qslot));
+    t->cap = cap * 2;
+    for(uint32_t i=0;i<cap;++i)
+        if(viejos[i].q) *qtabla_buscar(t, viejos[i].qid) = viejos[i];
+    free(viejos);
+}
+
+t_query* qtabla_get(t_qtabla* t, uint32_t qid){
+    return qtabla_buscar(t, qid)->q;
+}
+
+void qtabla_put(t_qtabla* t, t_query* q){
+    if((t->n + 1) * 10 > t->cap * 7) qtabla_crecer(t);
+    t_qslot* s = qtabla_buscar(t, q->id);
+    if(!s->q) t->n++;
+    s->qid = q->id; s->q = q;
+}
+
+t_query* qtabla_remove(t_qtabla* t, uint32_t qid){
+    uint32_t mask = t->cap - 1;
+    t_qslot* s = qtabla_buscar(t, qid);
+    t_query* q = s->q;
+    if(!q) return NULL;
+    t->n--;
+    // backward shift: cada elemento posterior del cluster que no esté en su
+    // posición ideal se mueve al hueco si el hueco queda "antes" de su hash
+    uint32_t hueco = (uint32_t)(s - t->slots);
+    for(uint32_t i = (hueco + 1) & mask; t->slots[i].q; i = (i + 1) & mask){
+        uint32_t ideal = qtabla_hash(t->slots[i].qid, mask);
+        if(((i - ideal) & mask) >= ((i - hueco) & mask)){
+            t->slots[hueco] = t->slots[i];
+            hueco = i;
+        }
+    }
+    t->slots[hueco].q = NULL;
+    return q;
+}
+
+// ====== Ciclo de vida ======
+// Referencias: la tabla, la conexión del QC, la cola READY y el next_q de un
+// Worker. running_qid no cuenta: se resuelve por la tabla, que suelta la
+// suya cuando la Query llega a EXIT.
+t_query* query_crear(char* path, uint32_t prioridad, int qc_fd){
+    t_query* q = calloc(1, sizeof(*q));
+    q->id = __sync_fetch_and_add(&g_next_qid, 1);  // autoincremental desde 0
+    q->path = path;
+    q->prioridad = prioridad;
+    q->pc = 0;
+    q->qc_fd = qc_fd;
+    q->worker_fd = -1;
+    q->estado = Q_READY;
+    q->ready_idx = -1;
+    q->aging_slot = -1;
+    q->refs = 1; // la de la tabla
+
+    qtabla_put(&g_queries, q);
+    return q;
+}
+
+void query_ref(t_query* q){
+    q->refs++;
+}
+
+void query_unref(t_query* q){
+    if(--q->refs != 0) return;
+    free(q->path);
+    free(q);
+}
+
+t_query* master_query_get(uint32_t qid){
+    return qtabla_get(&g_queries, qid);
+}
+
+// Pasa a EXIT y sale de la tabla; los mensajes tardíos con su qid (LECTURA,
+// DEVOLVER_PC) ya no la encuentran.
+void master_query_finalizar(t_query* q){
+    q->estado = Q_EXIT;
+    t_query* quitada = qtabla_remove(&g_queries, q->id);
+    if(quitada) query_unref(quitada);
+}
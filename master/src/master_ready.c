@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include "master.h"
+
+// ====== Cola READY ======
+// Heap binario indexado: cada t_query guarda su posición (ready_idx), así
+// también se puede quitar una del medio en O(log n) sin recorrer la cola.
+// Orden: (clave, llegada). La clave se fija al encolar y no cambia mientras
+// la Query está en READY (ver master_aging.c); con FIFO/RR es 0 y con MLFQ el
+// nivel (sólo un boost la recalcula, con ready_reordenar).
+// Sólo la usa el planificador.
+
+static uint64_t g_llegadas = 0;
+
+void ready_crear(t_ready* r, t_orden_ready orden){
+    r->v = NULL;
+    r->n = r->cap = 0;
+    r->orden = orden;
+}
+
+void ready_destruir(t_ready* r){
+    free(r->v);
+    r->v = NULL; r->n = r->cap = 0;
+}
+
+static bool antes(t_query* a, t_query* b){
+    if(a->clave != b->clave) return a->clave < b->clave;
+    return a->llegada < b->llegada;
+}
+
+static void poner(t_ready* r, int i, t_query* q){
+    r->v[i] = q;
+    q->ready_idx = i;
+}
+
+static void subir(t_ready* r, int i){
+    t_query* q = r->v[i];
+    while(i > 0){
+        int padre = (i - 1) / 2;
+        if(!antes(q, r->v[padre])) break;
+        poner(r, i, r->v[padre]);
+        i = padre;
+    }
+    poner(r, i, q);
+}
+
+static void bajar(t_ready* r, int i){
+    t_query* q = r->v[i];
+    for(;;){
+        int h = 2*i + 1;
+        if(h >= r->n) break;
+        if(h + 1 < r->n && antes(r->v[h+1], r->v[h])) h++;
+        if(!antes(r->v[h], q)) break;
+        poner(r, i, r->v[h]);
+        i = h;
+    }
+    poner(r, i, q);
+}
+
+void ready_push(t_ready* r, t_query* q){
+    if(r->n == r->cap){
+        r->cap = r->cap ? r->cap * 2 : 64;
+        r->v = realloc(r->v, (size_t)r->cap * sizeof(t_query*));
+    }
+    q->llegada = g_llegadas++;
+    q->clave = 0;
+    if(r->orden == ORDEN_PRIORIDAD)
+        q->clave = g_cfg.tiempo_aging_ms > 0
+            ? (uint64_t)q->prioridad * (uint64_t)g_cfg.tiempo_aging_ms + q->last_aging_ms
+            : q->prioridad;
+    else if(r->orden == ORDEN_NIVEL)
+        q->clave = q->nivel;
+    aging_agendar(q);
+    poner(r, r->n++, q);
+    subir(r, r->n - 1);
+}
+
+t_query* ready_peek(t_ready* r){
+    return r->n ? r->v[0] : NULL;
+}
+
+static t_query* quitar_en(t_ready* r, int i){
+    t_query* q = r->v[i];
+    q->ready_idx = -1;
+    aging_cancelar(q);
+    if(--r->n == i) return q;
+    t_query* ultima = r->v[r->n];
+    poner(r, i, ultima);
+    bajar(r, i);
+    subir(r, ultima->ready_idx);
+    return q;
+}
+
+t_query* ready_pop(t_ready* r){
+    return r->n ? quitar_en(r, 0) : NULL;
+}
+
+void ready_quitar(t_ready* r, t_query* q){
+    if(q->ready_idx >= 0 && q->ready_idx < r->n && r->v[q->ready_idx] == q) quitar_en(r, q->ready_idx);
+}
+
+// MLFQ: tras cambiar el nivel de las encoladas se recalcula la clave y se
+// rearma el heap de abajo hacia arriba (O(n)); la llegada se conserva.
+void ready_reordenar(t_ready* r){
+    if(r->orden != ORDEN_NIVEL) return;
+    for(int i=0;i<r->n;++i) r->v[i]->clave = r->v[i]->nivel;
+    for(int i=r->n/2 - 1; i>=0; --i) bajar(r, i);
+}
@@ -1,142 +1,183 @@
 #include <stdlib.h>
 #include <unistd.h>
-#include <commons/string.h>
+#include <string.h>
 #include <../../utils/src/utils/protocolos.h>
 #include "master.h"
 
 static uint32_t read_u32_from_pkg(t_paquete* p){
     uint32_t v=0; buffer_read(&v, p->buffer, sizeof(uint32_t)); return v;
 }
-static char* read_cstring_from_pkg(t_paquete* p){
-    int len=0; buffer_read(&len, p->buffer, sizeof(int));
-    char* s = calloc((size_t)len,1);
-    if(len) { memcpy(s, p->buffer->stream + p->buffer->offset, (size_t)len); p->buffer->offset += len; }
-    return s;
+// Un slot del Worker dejó su Query: si había una pendiente por desalojo,
+// ¡asignarla ya!; si no, queda libre para el próximo despacho.
+static void asignar_pendiente_o_liberar(t_slot* s){
+    t_worker* w = s->w;
+    t_query* nq = s->next_q;
+    s->next_q = NULL;
+    if(nq && nq->estado == Q_EXIT){ query_unref(nq); nq = NULL; } // su QC se fue mientras esperaba
+    if(!nq){ workers_libre(s); return; }
+    nq->estado = Q_EXEC;
+    nq->worker_fd = w->fd;
+    workers_ejecutando(s, nq);
+    send_master_asignar_query(w->fd, nq->id, nq->pc, nq->path);
+    log_envio_q_a_worker(nq->id, w->id);
+    query_unref(nq);
 }
 
-void master_handle_worker(int fd){
-    // Recibir WORKER_IDENTIFICACION
-    int opid = recibir_operacion(fd);
-    if(opid != WORKER_IDENTIFICACION){ close(fd); return; }
-    t_paquete* pkg = recibir_paquete(fd);
-    pkg->buffer->offset = 0;
-    uint32_t wid = read_u32_from_pkg(pkg);
-    eliminar_paquete(pkg);
-
-    // Registrar worker
-    t_worker* w = calloc(1,sizeof(*w));
-    w->id = wid; w->fd = fd; w->ocupado=false; w->running_qid=0xFFFFFFFF; w->next_q=NULL;
-
-    pthread_mutex_lock(&m_workers);
-    list_add(g_workers, w);
-    pthread_mutex_unlock(&m_workers);
-
-    log_worker_conectado(wid); // “## Se conecta el Worker <WORKER_ID> - Cantidad total de Workers: <CANTIDAD>” :contentReference[oaicite:12]{index=12}
-    send_master_ack(fd);
-
-    // Cada worker: loop de mensajes (LECTURA/FIN/PC...)
-    for(;;){
-        int op = recibir_operacion(fd);
-        if(op <= 0){
-            // desconexión de worker
-            // Si tenía una query ejecutando, finaliza con error y notificar al QC. :contentReference[oaicite:13]{index=13}
-            uint32_t qid_err = w->running_qid==0xFFFFFFFF? 0xFFFFFFFF : w->running_qid;
-            log_worker_desconectado(w->id, qid_err); // “Se finaliza la Query <QUERY_ID> ...” :contentReference[oaicite:14]{index=14}
-            if(qid_err != 0xFFFFFFFF){
-                // buscar la query y marcar EXIT + avisar al QC si sigue conectado
-                pthread_mutex_lock(&m_queries);
-                t_query* q = dictionary_get(g_queries, string_itoa(qid_err));
-                pthread_mutex_unlock(&m_queries);
-                if(q && q->qc_fd>=0){
-                    send_master_fin(q->qc_fd, "ERROR_WORKER_DESCONECTADO");
-                }
-            }
+bool master_handle_worker(t_master_conn* c, int op, t_paquete* pk){
+    pk->buffer->offset = 0;
+    t_worker* w = c->w;
+    if(!w){
+        // Recibir WORKER_IDENTIFICACION: [wid][slots] (sin slots = 1)
+        if(op != WORKER_IDENTIFICACION) return false;
+        uint32_t wid = read_u32_from_pkg(pk);
+        uint32_t slots = 1;
+        if(pk->buffer->size - pk->buffer->offset >= (int)sizeof(uint32_t)) slots = read_u32_from_pkg(pk);
+        if(slots == 0 || slots > 1024) return false;
+
+        // Registrar worker
+        w = calloc(1,sizeof(*w));
+        w->id = wid; w->fd = c->fd; w->slots = (int)slots;
+        c->w = w;
+
+        workers_alta(w);
+
+        log_worker_conectado(wid); // “## Se conecta el Worker <WORKER_ID> - Cantidad total de Workers: <CANTIDAD>” :contentReference[oaicite:12]{index=12}
+        send_master_ack(c->fd);
+        return true;
+    }
 
-            // remover worker
-            pthread_mutex_lock(&m_workers);
-            for(int i=0;i<list_size(g_workers);++i){
-                if(((t_worker*)list_get(g_workers,i))->fd == fd){
-                    list_remove(g_workers,i); break;
-                }
-            }
-            pthread_mutex_unlock(&m_workers);
-            if(w->next_q){
-                 master_enqueue_ready(w->next_q);
-                 w->next_q = NULL;
-            }
-            close(fd);
-            return;
+    // Cada worker: mensajes (LECTURA/FIN/PC...)
+    switch(op){
+    case WORKER_LECTURA: {
+        // [qid][file_tag][contenido] -> al QC va el mismo cuerpo sin el qid:
+        // sólo se reescribe la cabecera (mismo formato de strings en ambos lados).
+        // Va por la cola de salida del QC: si el QC no lee, no frena al
+        // planificador ni al Worker; si la cola se llena se lo desconecta.
+        uint32_t qid = read_u32_from_pkg(pk);
+        t_query* q = master_query_get(qid);
+        if(q && q->qc_fd>=0){
+            if(reenviar_paquete(pk, MASTER_LECTURA, sizeof(uint32_t), q->qc_fd) < 0){
+                log_error(g_logger, "El Query Control de la Query %u no consume sus lecturas: se lo desconecta", qid);
+                shutdown(q->qc_fd, SHUT_RDWR); // el reactor ve el cierre y lo avisa
+            } else log_envio_lectura_a_qc(qid, w->id); // “Se envía un mensaje de lectura ...” :contentReference[oaicite:15]{index=15}
         }
+    } break;
 
-        t_paquete* pk = recibir_paquete(fd);
-        pk->buffer->offset = 0;
-
-        switch(op){
-        case WORKER_LECTURA: {
-            uint32_t qid = read_u32_from_pkg(pk);
-            char* ft    = read_cstring_from_pkg(pk);
-            char* cont  = read_cstring_from_pkg(pk);
-
-            // reenviar al QC
-            pthread_mutex_lock(&m_queries);
-            t_query* q = dictionary_get(g_queries, string_itoa(qid));
-            pthread_mutex_unlock(&m_queries);
-            if(q && q->qc_fd>=0){
-                send_master_lectura(q->qc_fd, ft, cont);
-                log_envio_lectura_a_qc(qid, w->id); // “Se envía un mensaje de lectura ...” :contentReference[oaicite:15]{index=15}
-            }
-            free(ft); free(cont);
-        } break;
+    case WORKER_FIN: {
+        uint32_t qid = read_u32_from_pkg(pk);
+        char* motivo = leer_string_de_paquete(pk);
 
-        case WORKER_FIN: {
-            uint32_t qid = read_u32_from_pkg(pk);
-            char* motivo = read_cstring_from_pkg(pk);
+        // marcar EXIT, liberar worker, notificar QC
+        t_query* q = master_query_get(qid);
+        if(q){
+            if(q->qc_fd>=0) send_master_fin(q->qc_fd, motivo); // el QC loguea “## Query Finalizada - <MOTIVO>” :contentReference[oaicite:16]{index=16}
+            master_query_finalizar(q);
+        }
+        free(motivo);
+
+        log_fin_query_en_worker(qid, w->id); // “Se terminó la Query <QID> en el Worker <WID>” :contentReference[oaicite:17]{index=17}
+        // si terminó justo mientras se lo desalojaba, no va a llegar DEVOLVER_PC
+        t_slot* s = workers_slot_de(w, qid);
+        if(s) asignar_pendiente_o_liberar(s);
+    } break;
+
+    case WORKER_DEVOLVER_PC: {
+        uint32_t qid = read_u32_from_pkg(pk);
+        uint32_t pc  = read_u32_from_pkg(pk);
+        // almacenar PC para reanudación
+        t_query* q = master_query_get(qid); // NULL si finalizó mientras se desalojaba
+        if(q){ q->pc = pc; q->estado = Q_READY; q->worker_fd=-1; }
+
+        // la desalojada vuelve a READY
+        if(q) master_enqueue_ready(q);
+
+        t_slot* s = workers_slot_de(w, qid);
+        if(s) asignar_pendiente_o_liberar(s);
+    } break;
+
+    case WORKER_RESUMEN_CACHE:
+        if(pk->buffer->size < RESUMEN_CACHE_BYTES) return false;
+        memcpy(w->resumen, pk->buffer->stream, RESUMEN_CACHE_BYTES);
+        break;
+
+    case WORKER_STATUS: {
+        // [frames][ocupados][dirty][accesos][misses][n] + n*[qid][pc][ms][avances][espera_ms]
+        if(pk->buffer->size < (int)(6*sizeof(uint32_t))) return false;
+        w->frames          = read_u32_from_pkg(pk);
+        w->frames_ocupados = read_u32_from_pkg(pk);
+        w->dirty           = read_u32_from_pkg(pk);
+        uint32_t accesos   = read_u32_from_pkg(pk);
+        uint32_t misses    = read_u32_from_pkg(pk);
+        uint32_t n         = read_u32_from_pkg(pk);
+        if(n > (uint32_t)(pk->buffer->size - pk->buffer->offset) / (5*sizeof(uint32_t))) return false;
+        w->miss_permil = accesos ? (uint32_t)((uint64_t)misses * 1000 / accesos) : 0;
+        w->estado_ms = now_ms();
+        // progreso por Query: cambió su PC, o su hilo accedió a memoria o
+        // recibió respuestas de Storage (una instrucción larga no mueve el PC
+        // pero trabaja), o espera a Storage desde hace menos de TIMEOUT_WORKER
+        for(uint32_t i=0;i<n;++i){
+            uint32_t qid     = read_u32_from_pkg(pk);
+            uint32_t pc      = read_u32_from_pkg(pk);
+            uint32_t ms      = read_u32_from_pkg(pk);
+            uint32_t avances = read_u32_from_pkg(pk);
+            uint32_t espera  = read_u32_from_pkg(pk);
+            log_debug(g_logger, "Worker %u: Query %u en PC %u (%u ms, %u avances, espera %u ms)", w->id, qid, pc, ms, avances, espera);
+            t_slot* s = workers_slot_de(w, qid);
+            if(!s) continue;
+            bool avanzo = s->pc_reportado != pc || avances > 0
+                       || (espera > 0 && (g_cfg.timeout_worker_ms <= 0 || espera < (uint32_t)g_cfg.timeout_worker_ms));
+            s->pc_reportado = pc;
+            if(avanzo) workers_progreso(s);
+        }
+        workers_revisar_trabado(w);
+    } break;
+
+    case WORKER_ARCHIVOS_QUERY: {
+        // [path][n][hash]*n
+        char* path = leer_string_de_paquete(pk);
+        uint32_t n = 0;
+        if(!path || pk->buffer->size - pk->buffer->offset < (int)sizeof(uint32_t)){ free(path); return false; }
+        n = read_u32_from_pkg(pk);
+        if(n > HUELLA_MAX_ARCHIVOS || pk->buffer->size - pk->buffer->offset < (int)(n*sizeof(uint32_t))){ free(path); return false; }
+        uint32_t hashes[HUELLA_MAX_ARCHIVOS];
+        buffer_read(hashes, pk->buffer, (int)(n*sizeof(uint32_t)));
+        afinidad_aprender(path, hashes, (int)n);
+        free(path);
+    } break;
+
+    default:
+        break;
+    }
+    return true;
+}
 
-            // marcar EXIT, liberar worker, notificar QC
-            pthread_mutex_lock(&m_queries);
-            t_query* q = dictionary_get(g_queries, string_itoa(qid));
-            pthread_mutex_unlock(&m_queries);
+void master_worker_desconectado(t_master_conn* c){
+    t_worker* w = c->w;
+    if(!w) return;
+    // desconexión de worker
+    workers_baja(w);
+    // Las queries que tenía ejecutando finalizan con error y se avisa al QC. :contentReference[oaicite:13]{index=13}
+    if(w->ocupados == 0) log_worker_desconectado(w->id, 0xFFFFFFFF);
+    for(int i=0;i<w->slots;++i){
+        t_slot* s = &w->slot[i];
+        if(s->running_qid != 0xFFFFFFFF){
+            log_worker_desconectado(w->id, s->running_qid); // “Se finaliza la Query <QUERY_ID> ...” :contentReference[oaicite:14]{index=14}
+            // buscar la query y marcar EXIT + avisar al QC si sigue conectado
+            t_query* q = master_query_get(s->running_qid);
             if(q){
-                q->estado = Q_EXIT;
-                if(q->qc_fd>=0) send_master_fin(q->qc_fd, motivo); // el QC loguea “## Query Finalizada - <MOTIVO>” :contentReference[oaicite:16]{index=16}
-            }
-
-            w->ocupado=false; w->running_qid=0xFFFFFFFF;
-            log_fin_query_en_worker(qid, w->id); // “Se terminó la Query <QID> en el Worker <WID>” :contentReference[oaicite:17]{index=17}
-        } break;
-
-        case WORKER_DEVOLVER_PC: {
-            uint32_t qid = read_u32_from_pkg(pk);
-            uint32_t pc  = read_u32_from_pkg(pk);
-            // almacenar PC para reanudación
-            pthread_mutex_lock(&m_queries);
-            t_query* q = dictionary_get(g_queries, string_itoa(qid));
-            pthread_mutex_unlock(&m_queries);
-            if(q){ q->pc = pc; q->estado = Q_READY; q->worker_fd=-1; }
-
-            // la desalojada vuelve a READY
-            if(q) master_enqueue_ready(q);
-
-            // si había una Query pendiente para este worker (preempción), ¡asignarla ya!
-            if(w->next_q){
-                t_query* nq = w->next_q;
-                w->next_q = NULL;
-                nq->estado = Q_EXEC;
-                nq->worker_fd = w->fd;
-                w->ocupado = true; w->running_qid = nq->id;
-                send_master_asignar_query(w->fd, nq->id, nq->pc, nq->path);
-                log_envio_q_a_worker(nq->id, w->id);
-            } else {
-                // quedó libre
-                w->ocupado=false; w->running_qid=0xFFFFFFFF;
+                if(q->qc_fd>=0) send_master_fin(q->qc_fd, "ERROR_WORKER_DESCONECTADO");
+                master_query_finalizar(q);
             }
-
-
-        } break;
-
-        default:
-            break;
         }
-        eliminar_paquete(pk);
+        // la que esperaba este slot vuelve a READY
+        t_query* nq = s->next_q;
+        s->next_q = NULL;
+        if(nq){
+             master_enqueue_ready(nq);
+             query_unref(nq);
+        }
     }
+    free(w->slot);
+    free(w);
+    c->w = NULL;
 }
@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <sys/socket.h>
+#include "master.h"
+
+// ====== Workers libres y en ejecución ======
+// Cada Worker anuncia N slots; el Master despacha contra slots libres.
+// Libres: lista doblemente enlazada intrusiva de Workers con algún slot libre
+// (sacar/poner en O(1)). Un Worker que toma una Query y sigue con lugar pasa
+// al final, así las siguientes se reparten entre Workers en vez de llenar uno.
+// En ejecución: max-heap indexado de slots por la prioridad de la Query que
+// corren (mayor número = peor), así la víctima de un desalojo es la raíz. Un
+// slot con un desalojo ya pedido (next_q) sale del heap hasta que devuelva el PC.
+// Sólo los usa el planificador.
+
+#define SIN_QUERY 0xFFFFFFFF
+
+static t_worker* g_libres = NULL;
+static t_worker* g_libres_fin = NULL;
+static t_slot**  g_run = NULL;
+static int       g_run_n = 0, g_run_cap = 0;
+static int       g_slots_total = 0;
+
+static void libres_sacar(t_worker* w){
+    if(!w->en_libres) return;
+    if(w->libre_ant) w->libre_ant->libre_sig = w->libre_sig;
+    else g_libres = w->libre_sig;
+    if(w->libre_sig) w->libre_sig->libre_ant = w->libre_ant;
+    else g_libres_fin = w->libre_ant;
+    w->libre_sig = w->libre_ant = NULL;
+    w->en_libres = false;
+}
+
+// al frente: el que acaba de liberar un slot es el próximo en recibir
+static void libres_poner(t_worker* w){
+    if(w->en_libres || w->trabado) return;
+    w->libre_ant = NULL;
+    w->libre_sig = g_libres;
+    if(g_libres) g_libres->libre_ant = w;
+    else g_libres_fin = w;
+    g_libres = w;
+    w->en_libres = true;
+}
+
+static void libres_al_final(t_worker* w){
+    libres_sacar(w);
+    w->libre_sig = NULL;
+    w->libre_ant = g_libres_fin;
+    if(g_libres_fin) g_libres_fin->libre_sig = w;
+    else g_libres = w;
+    g_libres_fin = w;
+    w->en_libres = true;
+}
+
+static void run_poner(int i, t_slot* s){
+    g_run[i] = s;
+    s->run_idx = i;
+}
+
+static void run_subir(int i){
+    t_slot* s = g_run[i];
+    while(i > 0){
+        int padre = (i - 1) / 2;
+        if(g_run[padre]->running_prio >= s->running_prio) break;
+        run_poner(i, g_run[padre]);
+        i = padre;
+    }
+    run_poner(i, s);
+}
+
+static void run_bajar(int i){
+    t_slot* s = g_run[i];
+    for(;;){
+        int h = 2*i + 1;
+        if(h >= g_run_n) break;
+        if(h + 1 < g_run_n && g_run[h+1]->running_prio > g_run[h]->running_prio) h++;
+        if(g_run[h]->running_prio <= s->running_prio) break;
+        run_poner(i, g_run[h]);
+        i = h;
+    }
+    run_poner(i, s);
+}
+
+static void run_agregar(t_slot* s){
+    if(s->run_idx >= 0) return;
+    if(g_run_n == g_run_cap){
+        g_run_cap = g_run_cap ? g_run_cap * 2 : 16;
+        g_run = realloc(g_run, (size_t)g_run_cap * sizeof(t_slot*));
+    }
+    run_poner(g_run_n++, s);
+    run_subir(g_run_n - 1);
+}
+
+static void run_sacar(t_slot* s){
+    int i = s->run_idx;
+    if(i < 0) return;
+    s->run_idx = -1;
+    if(--g_run_n == i) return;
+    t_slot* ultimo = g_run[g_run_n];
+    run_poner(i, ultimo);
+    run_bajar(i);
+    run_subir(ultimo->run_idx);
+}
+
+void workers_alta(t_worker* w){
+    if(w->slots < 1) w->slots = 1;
+    w->slot = calloc((size_t)w->slots, sizeof(t_slot));
+    for(int i=0;i<w->slots;++i){
+        w->slot[i].w = w;
+        w->slot[i].running_qid = SIN_QUERY;
+        w->slot[i].run_idx = -1;
+        w->slot[i].q_nivel = -1;
+    }
+    w->ocupados = 0;
+    w->en_libres = false;
+    g_slots_total += w->slots;
+    list_add(g_workers, w);
+    libres_poner(w);
+}
+
+// no libera w->slot: el que llama todavía recorre sus Queries
+void workers_baja(t_worker* w){
+    libres_sacar(w);
+    for(int i=0;i<w->slots;++i){ run_sacar(&w->slot[i]); quantum_cancelar(&w->slot[i]); }
+    g_slots_total -= w->slots;
+    list_remove_element(g_workers, w);
+}
+
+t_slot* workers_slot_de(t_worker* w, uint32_t qid){
+    for(int i=0;i<w->slots;++i)
+        if(w->slot[i].running_qid == qid) return &w->slot[i];
+    return NULL;
+}
+
+void workers_libre(t_slot* s){
+    run_sacar(s);
+    quantum_cancelar(s);
+    s->desalojando = false;
+    if(s->running_qid != SIN_QUERY) s->w->ocupados--;
+    s->running_qid = SIN_QUERY;
+    workers_revisar_trabado(s->w); // si la trabada era esta, vuelve a recibir
+    libres_poner(s->w);
+}
+
+void workers_ejecutando(t_slot* s, t_query* q){
+    t_worker* w = s->w;
+    if(s->running_qid == SIN_QUERY){
+        w->ocupados++;
+        if(w->ocupados == w->slots) libres_sacar(w);
+        else if(w->en_libres) libres_al_final(w);
+    }
+    s->running_qid = q->id;
+    s->running_prio = q->prioridad;
+    s->pc_reportado = q->pc;
+    s->progreso_ms = now_ms(); // una asignación nueva cuenta como progreso
+    s->desalojando = false;
+    quantum_iniciar(s, q->nivel);
+    run_sacar(s);
+    if(!s->next_q) run_agregar(s);
+}
+
+void workers_reservar_desalojo(t_slot* s, t_query* nq){
+    s->next_q = nq;
+    run_sacar(s);
+}
+
+static t_slot* slot_libre(t_worker* w){
+    for(int i=0;i<w->slots;++i)
+        if(w->slot[i].running_qid == SIN_QUERY && !w->slot[i].next_q) return &w->slot[i];
+    return NULL;
+}
+
+// Un slot libre del primer Worker con lugar
+t_slot* workers_libre_primero(void){
+    return g_libres ? slot_libre(g_libres) : NULL;
+}
+
+// Un slot libre del Worker con lugar cuyo resumen de caché contiene más de
+// los File:Tags dados; empate (o ninguno) = el primero de la lista
+t_slot* workers_libre_con_afinidad(const uint32_t* hashes, int n){
+    t_worker* mejor = g_libres;
+    int mejor_n = 0;
+    for(t_worker* w = g_libres; w && mejor_n < n; w = w->libre_sig){
+        int c = 0;
+        for(int i=0;i<n;++i) if(resumen_contiene(w->resumen, hashes[i])) c++;
+        if(c > mejor_n){ mejor = w; mejor_n = c; }
+    }
+    return mejor ? slot_libre(mejor) : NULL;
+}
+
+// Carga relativa: proporción de slots ocupados, después tasa de fallos
+// (más fallos = más atado a Storage) y por último ocupación de frames.
+// Un Worker sin reportes compite sólo por slots.
+static bool mas_liviano(t_worker* a, t_worker* b){
+    uint64_t x = (uint64_t)a->ocupados * (uint64_t)b->slots, y = (uint64_t)b->ocupados * (uint64_t)a->slots;
+    if(x != y) return x < y;
+    if(a->miss_permil != b->miss_permil) return a->miss_permil < b->miss_permil;
+    x = (uint64_t)a->frames_ocupados * (uint64_t)(b->frames ? b->frames : 1);
+    y = (uint64_t)b->frames_ocupados * (uint64_t)(a->frames ? a->frames : 1);
+    return x < y;
+}
+
+// Un slot libre del Worker con lugar menos cargado según sus WORKER_STATUS
+t_slot* workers_libre_menos_cargado(void){
+    t_worker* mejor = g_libres;
+    for(t_worker* w = g_libres; w; w = w->libre_sig)
+        if(mas_liviano(w, mejor)) mejor = w;
+    return mejor ? slot_libre(mejor) : NULL;
+}
+
+// La Query del slot avanzó
+void workers_progreso(t_slot* s){
+    s->progreso_ms = now_ms();
+}
+
+// Query en el Worker que no avanza hace más de TIMEOUT_WORKER (NULL si ninguna)
+static t_slot* slot_trabado(t_worker* w, uint64_t ahora){
+    if(g_cfg.timeout_worker_ms <= 0) return NULL;
+    for(int i=0;i<w->slots;++i){
+        t_slot* s = &w->slot[i];
+        if(s->running_qid != SIN_QUERY && ahora - s->progreso_ms > (uint64_t)g_cfg.timeout_worker_ms) return s;
+    }
+    return NULL;
+}
+
+// Trabado mientras alguna de sus Queries lo esté: cuando avanzan (o terminan)
+// todas vuelve a recibir
+void workers_revisar_trabado(t_worker* w){
+    if(!w->trabado || slot_trabado(w, now_ms())) return;
+    w->trabado = false;
+    log_info(g_logger, "Worker %u: sus Queries vuelven a avanzar", w->id);
+    if(!w->caido && w->ocupados < w->slots) libres_poner(w);
+}
+
+// Con TIMEOUT_WORKER: sin latido se lo da por caído (se cierra la conexión y
+// sus Queries terminan como en una desconexión, sin esperar a TCP); con
+// latido pero sin progreso se lo saca de los libres hasta que avance.
+void workers_vigilar(uint64_t ahora){
+    uint64_t limite = (uint64_t)g_cfg.timeout_worker_ms;
+    for(int i=0;i<list_size(g_workers);++i){
+        t_worker* w = list_get(g_workers, i);
+        if(w->estado_ms == 0 || w->caido) continue;
+        if(ahora - w->estado_ms > limite){
+            log_warning(g_logger, "Worker %u sin latido hace %llu ms: se lo da por caído",
+                        w->id, (unsigned long long)(ahora - w->estado_ms));
+            w->caido = true;
+            libres_sacar(w);
+            shutdown(w->fd, SHUT_RDWR); // el reactor ve el cierre y lo avisa
+        } else if(!w->trabado){
+            t_slot* s = slot_trabado(w, ahora);
+            if(!s) continue;
+            log_warning(g_logger, "Worker %u: la Query %u no avanza hace %llu ms: no recibe Queries nuevas",
+                        w->id, s->running_qid, (unsigned long long)(ahora - s->progreso_ms));
+            w->trabado = true;
+            libres_sacar(w);
+        }
+    }
+}
+
+// El slot con la peor prioridad en ejecución, si es peor que `prio`
+t_slot* workers_victima(uint32_t prio){
+    if(g_run_n == 0 || g_run[0]->running_prio <= prio) return NULL;
+    return g_run[0];
+}
+
+// Nivel de multiprocesamiento: Queries que pueden correr a la vez
+int workers_slots_total(void){
+    return g_slots_total;
+}
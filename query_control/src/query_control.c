@@ -17,24 +17,6 @@ static t_log* logger_qc = NULL;
 static t_config* cfg_qc = NULL;
 static int socket_master = -1;
 
-// ====== Helpers de (de)serialización compatibles con tus paquetes ======
-static void paquete_add_string(t_paquete* p, const char* s) {
-    int32_t n = (int32_t)strlen(s);
-    int32_t n_net = htonl(n);
-    agregar_a_paquete(p, &n_net, sizeof(n_net));
-    agregar_a_paquete(p, (void*)s, n);
-}
-
-static char* paquete_read_string(t_paquete* p){
-    int32_t n_net = 0; buffer_read(&n_net, p->buffer, sizeof(n_net));
-    int32_t n = ntohl(n_net);
-    char* s = calloc((size_t)n+1, 1);
-    memcpy(s, p->buffer->stream + p->buffer->offset, (size_t)n);
-    p->buffer->offset += n;
-    return s;
-}
-
-
 // ====== Señales: cerrar prolijo ======
 static void sigint_handler(int _sig){
     (void)_sig;
@@ -96,7 +78,7 @@ int main(int argc, char** argv)
 
     {
         t_paquete* p = crear_paquete(QC_ENVIAR_QUERY);
-        paquete_add_string(p, path_query);   
+        agregar_string_a_paquete(p, path_query);   
         agregar_a_paquete(p, &prioridad, sizeof(uint32_t));
         enviar_paquete(p, socket_master);
         eliminar_paquete(p);
@@ -120,8 +102,8 @@ int main(int argc, char** argv)
 
         switch(op){
         case MASTER_LECTURA: {
-            char* file_tag = paquete_read_string(pkg);
-            char* contenido = paquete_read_string(pkg);
+            char* file_tag = leer_string_de_paquete(pkg);
+            char* contenido = leer_string_de_paquete(pkg);
             log_info(logger_qc, "## Lectura realizada: Archivo %s, contenido: %s",
                      file_tag ? file_tag : "(null)", contenido ? contenido : "(null)");
             free(file_tag);
@@ -129,7 +111,7 @@ int main(int argc, char** argv)
         } break;
 
         case MASTER_FIN: {
-            char* motivo = paquete_read_string(pkg);
+            char* motivo = leer_string_de_paquete(pkg);
             log_info(logger_qc, "## Query Finalizada - %s", motivo ? motivo : "DESCONOCIDO");
             free(motivo);
             eliminar_paquete(pkg);
@@ -6,6 +6,7 @@
 #include <sys/mman.h>   // mmap, msync, PROT_*, MAP_*, MS_SYNC
 #include <signal.h>     // signal
 #include <errno.h>      // errno / EEXIST
+#include <sys/epoll.h>
 
 t_st_cfg g_cfg;
 t_log*   g_logger = NULL;
@@ -17,6 +18,7 @@ uint32_t g_blocks_count = 0;
 t_bitarray* g_bitmap = NULL;
 int g_bitmap_fd = -1;
 pthread_mutex_t m_bitmap = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t* g_pins = NULL;   // envíos en curso por bloque físico (protegido por m_bitmap)
 
 t_config* g_hash_index_cfg = NULL;
 pthread_mutex_t m_hashidx = PTHREAD_MUTEX_INITIALIZER;
@@ -37,6 +39,8 @@ bool storage_load_config(const char* cfg_path){
     g_cfg.root           = strdup(config_get_string_value(c, "PUNTO_MONTAJE"));
     g_cfg.ret_op_ms      = (uint32_t)config_get_int_value(c, "RETARDO_OPERACION");
     g_cfg.ret_blk_ms     = (uint32_t)config_get_int_value(c, "RETARDO_ACCESO_BLOQUE");
+    g_cfg.hilos_op       = config_has_property(c, "HILOS_OPERACION") ? config_get_int_value(c, "HILOS_OPERACION") : 4;
+    if(g_cfg.hilos_op <= 0) g_cfg.hilos_op = 1;
     g_cfg.log_level      = level_from(config_get_string_value(c, "LOG_LEVEL"));
     g_logger = log_create("storage.log", "STORAGE", 1, g_cfg.log_level);
     config_destroy(c);
@@ -44,6 +48,7 @@ bool storage_load_config(const char* cfg_path){
 }
 void storage_free_config(void){
     if(g_bitmap) { bitarray_destroy(g_bitmap); g_bitmap=NULL; }
+    free(g_pins); g_pins=NULL;
     if(g_bitmap_fd!=-1){ close(g_bitmap_fd); g_bitmap_fd=-1; }
     if(g_hash_index_cfg){ config_save(g_hash_index_cfg); config_destroy(g_hash_index_cfg); g_hash_index_cfg=NULL; }
     if(g_server_fd!=-1){ close(g_server_fd); g_server_fd=-1; }
@@ -68,8 +73,9 @@ char* path_tag_dir(const char* file, const char* tag){ char* fd=path_file_dir(fi
 char* path_tag_metadata(const char* file, const char* tag){ char* td=path_tag_dir(file,tag); char* p=string_from_format("%s/metadata.config", td); free(td); return p; }
 char* path_tag_logical_dir(const char* file, const char* tag){ char* td=path_tag_dir(file,tag); char* p=string_from_format("%s/logical_blocks", td); free(td); return p; }
 char* path_tag_logical_block(const char* file, const char* tag, uint32_t logical){
-    char* ld=path_tag_logical_dir(file,tag); char* p=string_from_format("%s/%06u.dat", ld, logical); free(ld); return p;
+    char* ld=path_tag_logical_dir(file,tag); char* p=path_logical_block_en(ld, logical); free(ld); return p;
 }
+char* path_logical_block_en(const char* dir_logico, uint32_t logical){ return string_from_format("%s/%06u.dat", dir_logico, logical); }
 
 // ===== Delays =====
 void delay_op(void){ usleep(g_cfg.ret_op_ms * 1000); }
@@ -93,10 +99,28 @@ void bm_clear(uint32_t blk){
 
 int bm_find_free(void){
     pthread_mutex_lock(&m_bitmap);
-    for(uint32_t i=0;i<g_blocks_count;i++) if(!bitarray_test_bit(g_bitmap,i)){ pthread_mutex_unlock(&m_bitmap); return (int)i; }
+    for(uint32_t i=0;i<g_blocks_count;i++) if(!bitarray_test_bit(g_bitmap,i) && !g_pins[i]){ pthread_mutex_unlock(&m_bitmap); return (int)i; }
     pthread_mutex_unlock(&m_bitmap);
     return -1;
 }
+// un bloque libre pero todavía pineado no se reasigna: su contenido sigue saliendo por sendfile
+int bm_reserve_free(void){
+    pthread_mutex_lock(&m_bitmap);
+    for(uint32_t i=0;i<g_blocks_count;i++) if(!bitarray_test_bit(g_bitmap,i) && !g_pins[i]){
+        bitarray_set_bit(g_bitmap, i);
+        msync(g_bitmap->bitarray, g_bitmap->size, MS_SYNC);
+        pthread_mutex_unlock(&m_bitmap);
+        return (int)i;
+    }
+    pthread_mutex_unlock(&m_bitmap);
+    return -1;
+}
+
+// Pines: mientras un bloque físico se está enviando no se sobrescribe en el
+// lugar (PUT hace copy-on-write) ni se reasigna si queda libre.
+void bm_pin(uint32_t blk){ pthread_mutex_lock(&m_bitmap); g_pins[blk]++; pthread_mutex_unlock(&m_bitmap); }
+void bm_unpin(uint32_t blk){ pthread_mutex_lock(&m_bitmap); g_pins[blk]--; pthread_mutex_unlock(&m_bitmap); }
+bool bm_pinned(uint32_t blk){ pthread_mutex_lock(&m_bitmap); bool v = g_pins[blk] > 0; pthread_mutex_unlock(&m_bitmap); return v; }
 
 // ===== Hash index =====
 char* hi_get_block_by_md5(const char* md5hex){
@@ -272,6 +296,7 @@ bool fs_mount_or_format(void){
     g_fs_size   = (uint32_t)config_get_int_value(sb, "FS_SIZE");
     g_block_size= (uint32_t)config_get_int_value(sb, "BLOCK_SIZE");
     g_blocks_count = g_fs_size / g_block_size;
+    g_pins = calloc(g_blocks_count, sizeof(uint32_t));
     config_destroy(sb); free(sp);
 
     // crear arbol base
@@ -372,31 +397,66 @@ bool remove_logical_link(const char* logical_path){
     return unlink(logical_path) == 0;
 }
 
-// ===== Accept loop =====
+// ===== Reactor =====
+// epoll sobre el socket de escucha y las conexiones de los Workers: este hilo
+// sólo lee y decodifica, las operaciones corren en el pool.
 t_list* g_workers = NULL;
 pthread_mutex_t m_workers = PTHREAD_MUTEX_INITIALIZER;
 
-void* accept_loop(void* _){
+// Una conexión puede estar registrada dos veces: el socket y, si pasó a
+// memoria compartida, el eventfd de su anillo de entrada.
+typedef struct { int fd; int fd_evento; bool cerrada; t_st_conn* conn; } t_reactor_fd;
+
+void* storage_reactor_loop(void* _){
     (void)_;
     g_workers = list_create();
-    for(;;){
-        int fd = esperar_cliente(g_server_fd);
-        if(fd<0) continue;
-
-        // Handshake esperado:
-        int op = recibir_operacion(fd);
-        if(op != STORAGE_HANDSHAKE){ if(op>0){ t_paquete* throw=recibir_paquete(fd); if(throw) eliminar_paquete(throw);} close(fd); continue; }
+    int epfd = epoll_create1(0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL }; // NULL = socket de escucha
+    epoll_ctl(epfd, EPOLL_CTL_ADD, g_server_fd, &ev);
 
-        // responder BLOCK_SIZE
-        t_paquete* resp = crear_paquete(STORAGE_BLOCK_SIZE);
-        agregar_a_paquete(resp, &g_block_size, sizeof(uint32_t));
-        enviar_paquete(resp, fd); eliminar_paquete(resp);
-
-        pthread_mutex_lock(&m_workers); list_add(g_workers, (void*)(intptr_t)fd); int cant=list_size(g_workers); pthread_mutex_unlock(&m_workers);
-        log_worker_conectado(0, cant); // no tenemos WORKER_ID en el protocolo → 0
-
-        pthread_t th; pthread_create(&th,NULL,(void*(*)(void*))handle_worker,(void*)(intptr_t)fd);
-        pthread_detach(th);
+    struct epoll_event evs[64];
+    t_reactor_fd* cerradas[64];
+    for(;;){
+        int n = epoll_wait(epfd, evs, 64, -1);
+        if(n < 0){ if(errno == EINTR) continue; log_error(g_logger,"epoll_wait falló"); break; }
+
+        int n_cerradas = 0;
+        for(int i=0;i<n;++i){
+            t_reactor_fd* rf = evs[i].data.ptr;
+            if(!rf){
+                int fd = esperar_cliente(g_server_fd);
+                if(fd<0) continue;
+                rf = calloc(1, sizeof(*rf));
+                rf->fd = fd; rf->fd_evento = -1; rf->conn = st_conn_crear(fd);
+                struct epoll_event cev = { .events = EPOLLIN, .data.ptr = rf };
+                epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &cev);
+                continue;
+            }
+            if(rf->cerrada) continue; // el otro fd de la misma conexión ya la cerró en esta vuelta
+
+            t_conexion* cx = conexion_de(rf->fd);
+            int r = conexion_leer_disponible(cx);
+            if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+            bool seguir = r > 0;
+            int op; t_paquete* pk;
+            while(seguir && (pk = conexion_extraer_paquete(cx, &op))) seguir = st_conn_mensaje(rf->conn, op, pk);
+            if(seguir && cx->invalida){ log_error(g_logger,"Mensaje fuera de protocolo de un Worker: se cierra la conexión"); seguir = false; }
+
+            // el handshake puede haber pasado la conexión a memoria compartida
+            if(seguir && rf->fd_evento < 0 && conexion_fd_evento(cx) >= 0){
+                rf->fd_evento = conexion_fd_evento(cx);
+                struct epoll_event eev = { .events = EPOLLIN, .data.ptr = rf };
+                epoll_ctl(epfd, EPOLL_CTL_ADD, rf->fd_evento, &eev);
+            }
+            if(!seguir){
+                epoll_ctl(epfd, EPOLL_CTL_DEL, rf->fd, NULL);
+                if(rf->fd_evento >= 0) epoll_ctl(epfd, EPOLL_CTL_DEL, rf->fd_evento, NULL);
+                st_conn_cerrar(rf->conn); // el fd se libera cuando termine el último pedido
+                rf->cerrada = true;
+                cerradas[n_cerradas++] = rf;
+            }
+        }
+        for(int i=0;i<n_cerradas;++i) free(cerradas[i]);
     }
     return NULL;
 }
@@ -405,12 +465,14 @@ int main(int argc, char** argv){
     if(argc<2){ fprintf(stderr,"Uso: %s storage.config\n", argv[0]); return 1; }
     if(!storage_load_config(argv[1])){ fprintf(stderr,"No pude cargar config\n"); return 1; }
     signal(SIGINT, sigint_handler);
+    signal(SIGPIPE, SIG_IGN); // sendfile a un Worker caído: que vuelva EPIPE
 
     if(!fs_mount_or_format()){ fprintf(stderr,"No pude montar/formatear FS\n"); return 1; }
 
     g_server_fd = iniciar_servidor(g_cfg.puerto_escucha);
     if(g_server_fd<0){ log_error(g_logger,"No pude iniciar servidor en %s", g_cfg.puerto_escucha); return 1; }
-    pthread_t th; pthread_create(&th,NULL,accept_loop,NULL); pthread_detach(th);
+    storage_pool_iniciar(g_cfg.hilos_op);
+    pthread_t th; pthread_create(&th,NULL,storage_reactor_loop,NULL); pthread_detach(th);
 
     for(;;) pause();
     return 0;
@@ -8,6 +8,7 @@
 #include <commons/bitarray.h>
 #include <commons/collections/list.h>
 #include <commons/collections/dictionary.h>
+#include <commons/collections/queue.h>
 #include <commons/string.h>
 #include <commons/crypto.h>   // crypto_md5
 #include <sys/stat.h>
@@ -24,6 +25,7 @@ typedef struct {
     char* root;                  // PUNTO_MONTAJE
     uint32_t ret_op_ms;          // RETARDO_OPERACION
     uint32_t ret_blk_ms;         // RETARDO_ACCESO_BLOQUE
+    int   hilos_op;              // HILOS_OPERACION (pool que ejecuta los pedidos)
     t_log_level log_level;       // LOG_LEVEL (string->level)
 } t_st_cfg;
 
@@ -46,6 +48,7 @@ char* path_tag_dir(const char* file, const char* tag);
 char* path_tag_metadata(const char* file, const char* tag);
 char* path_tag_logical_dir(const char* file, const char* tag);
 char* path_tag_logical_block(const char* file, const char* tag, uint32_t logical);
+char* path_logical_block_en(const char* dir_logico, uint32_t logical);
 
 // ====== FS mount / format ======
 bool  storage_load_config(const char* cfg_path);
@@ -63,6 +66,10 @@ bool  bm_is_set(uint32_t blk);
 void  bm_set(uint32_t blk);
 void  bm_clear(uint32_t blk);
 int   bm_find_free(void);           // -1 si no hay
+int   bm_reserve_free(void);        // busca y marca en un solo paso; -1 si no hay
+void  bm_pin(uint32_t blk);         // bloque con un envío en curso
+void  bm_unpin(uint32_t blk);
+bool  bm_pinned(uint32_t blk);
 
 extern t_config* g_hash_index_cfg;  // blocks_hash_index.config
 extern pthread_mutex_t m_hashidx;
@@ -81,6 +88,28 @@ t_tagmeta* meta_load(const char* file, const char* tag);
 bool       meta_save(const char* file, const char* tag, t_tagmeta* m);
 void       meta_destroy(t_tagmeta* m);
 
+// ====== Locks por File:Tag ======
+typedef struct {
+    char* key;                // "file:tag"
+    int   refs;               // hilos usando/esperando el lock + handles abiertos
+    pthread_mutex_t mx;
+    char* file;
+    char* tag;
+    char* dir_logico;         // ruta ya resuelta de logical_blocks
+    t_tagmeta* meta;          // caché para los pedidos por handle (NULL = leer de disco)
+} t_tag_entry;
+
+t_tag_entry* tag_lock(const char* file, const char* tag);
+void         tag_unlock(t_tag_entry* e);   // acepta NULL; invalida la caché de metadata
+// handles: la entrada vive mientras tenga referencias
+t_tag_entry* tag_ref(const char* file, const char* tag);
+void         tag_acquire(t_tag_entry* e);
+void         tag_unref(t_tag_entry* e);
+void         tag_entry_lock(t_tag_entry* e);
+void         tag_entry_unlock(t_tag_entry* e);  // sin invalidar la caché
+void         tag_lock_pair(const char* f1, const char* t1, const char* f2, const char* t2,
+                           t_tag_entry** e1, t_tag_entry** e2); // *e2 = NULL si son el mismo
+
 // ====== Helpers ======
 void    delay_op(void);
 void    delay_block(void);
@@ -98,9 +127,13 @@ bool    remove_logical_link(const char* logical_path);
 #define ERR_IO                   6u
 
 // ====== Server / Protocolo ======
-void* accept_loop(void* _);
-void  handle_worker(int fd);
-// expone lista y mutex para contarlos en el protocolo
+void* storage_reactor_loop(void* _);
+void  storage_pool_iniciar(int hilos);
+typedef struct t_st_conn t_st_conn;
+t_st_conn* st_conn_crear(int fd);
+bool  st_conn_mensaje(t_st_conn* c, int op, t_paquete* pk); // false = cerrar
+void  st_conn_cerrar(t_st_conn* c);
+// expone lista (t_st_conn*) y mutex para contarlos en el protocolo
 extern t_list* g_workers;
 extern pthread_mutex_t m_workers;
 
@@ -111,8 +144,19 @@ uint32_t op_truncate(uint32_t qid, const char* file, const char* tag, uint32_t n
 uint32_t op_tag(uint32_t qid, const char* fsrc, const char* tsrc, const char* fdst, const char* tdst);
 uint32_t op_commit(uint32_t qid, const char* file, const char* tag);
 uint32_t op_delete(uint32_t qid, const char* file, const char* tag);
-uint32_t op_get_block(uint32_t qid, const char* file, const char* tag, uint32_t logical, char** out_data); // malloc BLOCK_SIZE
+// Bloque abierto y pineado para mandarlo con sendfile; se suelta después del envío
+typedef struct { int fd; uint32_t phys; } t_bloque_pin;
+void     bloque_pin_soltar(t_bloque_pin* b);
+
+uint32_t op_get_block(uint32_t qid, const char* file, const char* tag, uint32_t logical, t_bloque_pin* out);
 uint32_t op_put_block(uint32_t qid, const char* file, const char* tag, uint32_t logical, const char* data, uint32_t len);
+// vectorizadas: una carga/guardado de metadata para todo el lote
+uint32_t op_get_blocks(uint32_t qid, const char* file, const char* tag, uint32_t n, const uint32_t* logicals, t_bloque_pin* out); // out: n elementos
+uint32_t op_put_blocks(uint32_t qid, const char* file, const char* tag, uint32_t n, const uint32_t* logicals, const char* const* datas, uint32_t len);
+// por handle: la entrada queda referenciada hasta tag_unref (STORAGE_CLOSE)
+uint32_t op_open(uint32_t qid, const char* file, const char* tag, t_tag_entry** out);
+uint32_t op_get_blocks_h(uint32_t qid, t_tag_entry* e, uint32_t n, const uint32_t* logicals, t_bloque_pin* out);
+uint32_t op_put_blocks_h(uint32_t qid, t_tag_entry* e, uint32_t n, const uint32_t* logicals, const char* const* datas, uint32_t len);
 
 // ====== Logs requeridos ======
 void log_worker_conectado(uint32_t wid, int cant);
@@ -71,8 +71,7 @@ static char* md5_block(const char* data, uint32_t len){
     return crypto_md5((char*)data, len);
 }
 
-uint32_t op_create(uint32_t qid, const char* file, const char* tag){
-    delay_op();
+static uint32_t create_locked(uint32_t qid, const char* file, const char* tag){
 
     // evitar duplicados: ya existe metadata del mismo File:Tag
     char* mp = path_tag_metadata(file, tag);
@@ -90,8 +89,7 @@ uint32_t op_create(uint32_t qid, const char* file, const char* tag){
     return STATUS_OK;
 }
 
-uint32_t op_truncate(uint32_t qid, const char* file, const char* tag, uint32_t new_size){
-    delay_op();
+static uint32_t truncate_locked(uint32_t qid, const char* file, const char* tag, uint32_t new_size){
     t_tagmeta* m = meta_load(file,tag); if(!m) return ERR_TAG_INEXISTENTE;
     if(strcmp(m->estado,"COMMITED")==0){ meta_destroy(m); return ERR_NO_PERMITIDO; }
     if(new_size % g_block_size){ meta_destroy(m); return ERR_FUERA_DE_LIMITE; }
@@ -139,8 +137,7 @@ uint32_t op_truncate(uint32_t qid, const char* file, const char* tag, uint32_t n
     return STATUS_OK;
 }
 
-uint32_t op_tag(uint32_t qid, const char* fsrc, const char* tsrc, const char* fdst, const char* tdst){
-    delay_op();
+static uint32_t tag_locked(uint32_t qid, const char* fsrc, const char* tsrc, const char* fdst, const char* tdst){
     t_tagmeta* ms = meta_load(fsrc,tsrc); if(!ms) return ERR_TAG_INEXISTENTE;
     if(!ensure_dirs_for_tag(fdst,tdst)){ meta_destroy(ms); return ERR_IO; }
 
@@ -164,8 +161,7 @@ uint32_t op_tag(uint32_t qid, const char* fsrc, const char* tsrc, const char* fd
     return STATUS_OK;
 }
 
-uint32_t op_commit(uint32_t qid, const char* file, const char* tag){
-    delay_op();
+static uint32_t commit_locked(uint32_t qid, const char* file, const char* tag){
     t_tagmeta* m = meta_load(file,tag); if(!m) return ERR_TAG_INEXISTENTE;
     if(strcmp(m->estado,"COMMITED")==0){ meta_destroy(m); return STATUS_OK; }
 
@@ -216,8 +212,7 @@ uint32_t op_commit(uint32_t qid, const char* file, const char* tag){
     return STATUS_OK;
 }
 
-uint32_t op_delete(uint32_t qid, const char* file, const char* tag){
-    delay_op();
+static uint32_t delete_locked(uint32_t qid, const char* file, const char* tag){
     if(strcmp(file,"initial_file")==0 && strcmp(tag,"BASE")==0) return ERR_NO_PERMITIDO;
 
     t_tagmeta* m = meta_load(file,tag); if(!m) return ERR_TAG_INEXISTENTE;
@@ -255,46 +250,59 @@ uint32_t op_delete(uint32_t qid, const char* file, const char* tag){
     return STATUS_OK;
 }
 
-uint32_t op_get_block(uint32_t qid, const char* file, const char* tag, uint32_t logical, char** out_data){
-    t_tagmeta* m = meta_load(file,tag); if(!m) return ERR_TAG_INEXISTENTE;
+// ====== Bloques ======
+// Todo trabaja sobre metadata ya cargada y con el lock del File:Tag tomado:
+// los pedidos por nombre la leen de disco en cada operación, los pedidos por
+// handle usan la que queda en caché en la entrada (ver storage_tags.c).
+
+// Abre el bloque físico y lo pinea: desde acá hasta bloque_pin_soltar nadie
+// lo modifica, así el envío puede hacerse fuera del lock del File:Tag.
+static uint32_t pin_logical(uint32_t qid, t_tag_entry* e, t_tagmeta* m, uint32_t logical, t_bloque_pin* out){
     uint32_t blocks = (uint32_t)list_size(m->blocks);
-    if(logical >= blocks){ meta_destroy(m); return ERR_FUERA_DE_LIMITE; }
+    if(logical >= blocks) return ERR_FUERA_DE_LIMITE;
     uint32_t phys = *(uint32_t*)list_get(m->blocks, logical);
-    char* data = malloc(g_block_size);
-    if(!read_physical(phys, data)){ free(data); meta_destroy(m); return ERR_IO; }
-    *out_data = data;
-    log_bloque_leido(qid, file, tag, logical);
-    meta_destroy(m);
+    char* p = path_block_n(phys);
+    int fd = open(p, O_RDONLY);
+    free(p);
+    if(fd < 0) return ERR_IO;
+    bm_pin(phys);
+    out->fd = fd; out->phys = phys;
+    log_bloque_leido(qid, e->file, e->tag, logical);
     return STATUS_OK;
 }
 
-uint32_t op_put_block(uint32_t qid, const char* file, const char* tag, uint32_t logical, const char* data, uint32_t len){
-    t_tagmeta* m = meta_load(file,tag); if(!m) return ERR_TAG_INEXISTENTE;
-    if(strcmp(m->estado,"COMMITED")==0){ meta_destroy(m); return ERR_NO_PERMITIDO; }
+void bloque_pin_soltar(t_bloque_pin* b){
+    if(b->fd < 0) return;
+    close(b->fd); bm_unpin(b->phys);
+    b->fd = -1;
+}
+
+// *meta_sucia queda en true si cambió el bloque físico (hay que guardar metadata)
+static uint32_t write_logical(uint32_t qid, t_tag_entry* e, t_tagmeta* m, uint32_t logical, const char* data, uint32_t len, bool* meta_sucia){
     uint32_t blocks = (uint32_t)list_size(m->blocks);
-    if(logical >= blocks){ meta_destroy(m); return ERR_FUERA_DE_LIMITE; }
+    if(logical >= blocks) return ERR_FUERA_DE_LIMITE;
 
     uint32_t phys = *(uint32_t*)list_get(m->blocks, logical);
     uint32_t refs = physical_refcount(phys);
 
-    // Si hay más de una referencia (o es bloque 0), asignar bloque nuevo
-    if(refs > 1 || phys==0){
-        int freeblk = bm_find_free(); if(freeblk<0){ meta_destroy(m); return ERR_SIN_ESPACIO; }
-        bm_set((uint32_t)freeblk);
+    // Si hay más de una referencia (o es bloque 0, o se está enviando), asignar bloque nuevo
+    if(refs > 1 || phys==0 || bm_pinned(phys)){
+        int freeblk = bm_reserve_free(); if(freeblk<0) return ERR_SIN_ESPACIO;
         log_bf_reservado(qid, (uint32_t)freeblk);
 
         // escribir data en el nuevo físico
-        if(!write_physical((uint32_t)freeblk, data, len)){ meta_destroy(m); return ERR_IO; }
+        if(!write_physical((uint32_t)freeblk, data, len)) return ERR_IO;
 
         // actualizar hard link lógico
-        char* lp = path_tag_logical_block(file,tag,logical);
+        char* lp = path_logical_block_en(e->dir_logico, logical);
         char* nb = path_block_n((uint32_t)freeblk);
         replace_hardlink(lp, nb);
-        log_hl_agregado(qid, file, tag, logical, (uint32_t)freeblk);
+        log_hl_agregado(qid, e->file, e->tag, logical, (uint32_t)freeblk);
         free(lp); free(nb);
 
         // actualizar metadata
         *(uint32_t*)list_get(m->blocks, logical) = (uint32_t)freeblk;
+        *meta_sucia = true;
 
         // liberar anterior si quedó sin refs y no es 0
         if(physical_refcount(phys)==0 && phys!=0){
@@ -303,11 +311,131 @@ uint32_t op_put_block(uint32_t qid, const char* file, const char* tag, uint32_t
         }
     } else {
         // única referencia: escribir directo sobre el mismo físico
-        if(!write_physical(phys, data, len)){ meta_destroy(m); return ERR_IO; }
+        if(!write_physical(phys, data, len)) return ERR_IO;
     }
+    log_bloque_escrito(qid, e->file, e->tag, logical);
+    return STATUS_OK;
+}
 
-    meta_save(file,tag,m);
-    log_bloque_escrito(qid, file, tag, logical);
+static uint32_t pin_blocks(uint32_t qid, t_tag_entry* e, t_tagmeta* m, uint32_t n, const uint32_t* logicals, t_bloque_pin* out){
+    uint32_t st = STATUS_OK, i = 0;
+    for(; i<n && st==STATUS_OK; ++i) st = pin_logical(qid, e, m, logicals[i], &out[i]);
+    // si falló alguno, soltar los que ya se habían pineado
+    if(st != STATUS_OK) for(uint32_t j=0; j+1<i; ++j) bloque_pin_soltar(&out[j]);
+    return st;
+}
+
+static uint32_t write_blocks(uint32_t qid, t_tag_entry* e, t_tagmeta* m, uint32_t n, const uint32_t* logicals, const char* const* datas, uint32_t len){
+    if(strcmp(m->estado,"COMMITED")==0) return ERR_NO_PERMITIDO;
+    uint32_t st = STATUS_OK;
+    bool sucia = false;
+    for(uint32_t i=0; i<n && st==STATUS_OK; ++i)
+        st = write_logical(qid, e, m, logicals[i], datas[i], len, &sucia);
+    // lo que se alcanzó a escribir queda registrado aunque falle un bloque
+    if(sucia) meta_save(e->file, e->tag, m);
+    return st;
+}
+
+static uint32_t get_blocks_locked(uint32_t qid, t_tag_entry* e, uint32_t n, const uint32_t* logicals, t_bloque_pin* out){
+    t_tagmeta* m = meta_load(e->file, e->tag); if(!m) return ERR_TAG_INEXISTENTE;
+    uint32_t st = pin_blocks(qid, e, m, n, logicals, out);
     meta_destroy(m);
+    return st;
+}
+
+static uint32_t put_blocks_locked(uint32_t qid, t_tag_entry* e, uint32_t n, const uint32_t* logicals, const char* const* datas, uint32_t len){
+    t_tagmeta* m = meta_load(e->file, e->tag); if(!m) return ERR_TAG_INEXISTENTE;
+    uint32_t st = write_blocks(qid, e, m, n, logicals, datas, len);
+    meta_destroy(m);
+    return st;
+}
+
+// versión por handle: la metadata se lee una vez y queda en la entrada
+static t_tagmeta* entry_meta(t_tag_entry* e){
+    if(!e->meta) e->meta = meta_load(e->file, e->tag);
+    return e->meta;
+}
+
+// ====== API: cada operación toma el lock de su File:Tag ======
+uint32_t op_create(uint32_t qid, const char* file, const char* tag){
+    delay_op();
+    t_tag_entry* e = tag_lock(file, tag);
+    uint32_t st = create_locked(qid, file, tag);
+    tag_unlock(e);
+    return st;
+}
+uint32_t op_truncate(uint32_t qid, const char* file, const char* tag, uint32_t new_size){
+    delay_op();
+    t_tag_entry* e = tag_lock(file, tag);
+    uint32_t st = truncate_locked(qid, file, tag, new_size);
+    tag_unlock(e);
+    return st;
+}
+uint32_t op_tag(uint32_t qid, const char* fsrc, const char* tsrc, const char* fdst, const char* tdst){
+    delay_op();
+    t_tag_entry *es, *ed;
+    tag_lock_pair(fsrc, tsrc, fdst, tdst, &es, &ed);
+    uint32_t st = tag_locked(qid, fsrc, tsrc, fdst, tdst);
+    tag_unlock(ed); tag_unlock(es);
+    return st;
+}
+uint32_t op_commit(uint32_t qid, const char* file, const char* tag){
+    delay_op();
+    t_tag_entry* e = tag_lock(file, tag);
+    uint32_t st = commit_locked(qid, file, tag);
+    tag_unlock(e);
+    return st;
+}
+uint32_t op_delete(uint32_t qid, const char* file, const char* tag){
+    delay_op();
+    t_tag_entry* e = tag_lock(file, tag);
+    uint32_t st = delete_locked(qid, file, tag);
+    tag_unlock(e);
+    return st;
+}
+uint32_t op_get_block(uint32_t qid, const char* file, const char* tag, uint32_t logical, t_bloque_pin* out){
+    return op_get_blocks(qid, file, tag, 1, &logical, out);
+}
+uint32_t op_put_block(uint32_t qid, const char* file, const char* tag, uint32_t logical, const char* data, uint32_t len){
+    return op_put_blocks(qid, file, tag, 1, &logical, &data, len);
+}
+// Lotes: el RETARDO_ACCESO_BLOQUE por bloque lo sigue aplicando el protocolo, fuera del lock
+uint32_t op_get_blocks(uint32_t qid, const char* file, const char* tag, uint32_t n, const uint32_t* logicals, t_bloque_pin* out){
+    t_tag_entry* e = tag_lock(file, tag);
+    uint32_t st = get_blocks_locked(qid, e, n, logicals, out);
+    tag_unlock(e);
+    return st;
+}
+uint32_t op_put_blocks(uint32_t qid, const char* file, const char* tag, uint32_t n, const uint32_t* logicals, const char* const* datas, uint32_t len){
+    t_tag_entry* e = tag_lock(file, tag);
+    uint32_t st = put_blocks_locked(qid, e, n, logicals, datas, len);
+    tag_unlock(e);
+    return st;
+}
+
+// ====== API por handle (STORAGE_OPEN) ======
+// La entrada ya está referenciada por el handle; no se invalida la caché al soltar.
+uint32_t op_open(uint32_t qid, const char* file, const char* tag, t_tag_entry** out){
+    (void)qid;
+    t_tag_entry* e = tag_ref(file, tag);
+    tag_entry_lock(e);
+    bool existe = entry_meta(e) != NULL;
+    tag_entry_unlock(e);
+    if(!existe){ tag_unref(e); return ERR_TAG_INEXISTENTE; }
+    *out = e;
     return STATUS_OK;
 }
+uint32_t op_get_blocks_h(uint32_t qid, t_tag_entry* e, uint32_t n, const uint32_t* logicals, t_bloque_pin* out){
+    tag_entry_lock(e);
+    t_tagmeta* m = entry_meta(e);
+    uint32_t st = m ? pin_blocks(qid, e, m, n, logicals, out) : ERR_TAG_INEXISTENTE;
+    tag_entry_unlock(e);
+    return st;
+}
+uint32_t op_put_blocks_h(uint32_t qid, t_tag_entry* e, uint32_t n, const uint32_t* logicals, const char* const* datas, uint32_t len){
+    tag_entry_lock(e);
+    t_tagmeta* m = entry_meta(e);
+    uint32_t st = m ? write_blocks(qid, e, m, n, logicals, datas, len) : ERR_TAG_INEXISTENTE;
+    tag_entry_unlock(e);
+    return st;
+}
@@ -4,105 +4,445 @@
 static char* read_cstring(t_paquete* p){ int len=0; buffer_read(&len,p->buffer,sizeof(int)); char* s=calloc((size_t)len,1); if(len){ memcpy(s,p->buffer->stream+p->buffer->offset,(size_t)len); p->buffer->offset+=len; } return s; }
 static uint32_t read_u32(t_paquete* p){ uint32_t v=0; buffer_read(&v,p->buffer,sizeof(uint32_t)); return v; }
 
-static void respond_status(int fd, int opcode, uint32_t status){
-    t_paquete* r = crear_paquete(opcode);
-    agregar_a_paquete(r, &status, sizeof(uint32_t));
-    enviar_paquete(r, fd); eliminar_paquete(r);
+// ====== Conexión de un Worker ======
+// Un handle abierto. h == 0: slot libre; e == NULL con h != 0: borrado.
+typedef struct {
+    uint32_t     h;
+    t_tag_entry* e;
+} t_st_handle;
+
+// El reactor decodifica los pedidos y los encola; el pool los ejecuta en
+// paralelo, pero las respuestas salen en el orden en que llegaron los pedidos.
+struct t_st_conn {
+    int      fd;
+    bool     handshake_ok;
+    bool     cerrada;
+    bool     enviando;      // algún hilo está mandando respuestas (sin c->mx tomado)
+    int      refs;          // reactor + pedidos sin responder (atómico)
+    uint32_t next_seq;      // próximo número para un pedido entrante (lo usa sólo el reactor)
+    uint32_t next_envio;    // número de la próxima respuesta que puede salir
+    struct t_st_respuesta* listas; // terminadas esperando turno, ordenadas por seq
+    t_st_handle* handles;   // STORAGE_OPEN: handle -> entrada (direccionamiento abierto)
+    uint32_t cap_handles;   // potencia de 2 (0 = sin tabla)
+    uint32_t n_handles;     // vivos + borrados (los borrados ocupan hasta rehashear)
+    uint32_t next_handle;   // nunca se reusa un número en la vida de la conexión
+    pthread_mutex_t mx;
+};
+
+// Respuesta ya armada: el paquete y, opcionalmente, bloques pineados que
+// viajan detrás por sendfile
+typedef struct t_st_respuesta {
+    uint32_t      seq;
+    t_paquete*    pk;
+    t_bloque_pin* bloques;  // malloc o NULL
+    int           n_bloques;
+    struct t_st_respuesta* sig;
+} t_st_respuesta;
+
+typedef struct {
+    t_st_conn* conn;
+    uint32_t   seq;
+    int        op;
+    uint32_t   req_id;
+    t_paquete* pk;
+} t_st_pedido;
+
+// Toda respuesta arranca con el id del pedido, así el Worker puede tener
+// varios en vuelo y emparejarlos aunque vuelvan en otro orden.
+static t_st_respuesta* resp_status(int opcode, uint32_t req_id, uint32_t status){
+    t_st_respuesta* r = calloc(1, sizeof(*r));
+    r->pk = crear_paquete_con_capacidad(opcode, 2*sizeof(uint32_t));
+    agregar_a_paquete(r->pk, &req_id, sizeof(uint32_t));
+    agregar_a_paquete(r->pk, &status, sizeof(uint32_t));
+    return r;
+}
+
+static void conn_soltar(t_st_conn* c){
+    if(__sync_sub_and_fetch(&c->refs, 1) == 0){
+        liberar_conexion(c->fd);
+        for(uint32_t i=0;i<c->cap_handles;++i) if(c->handles[i].e) tag_unref(c->handles[i].e);
+        free(c->handles);
+        pthread_mutex_destroy(&c->mx);
+        free(c);
+    }
+}
+
+static void resp_destruir(t_st_respuesta* r){
+    for(int i=0;i<r->n_bloques;++i) bloque_pin_soltar(&r->bloques[i]);
+    eliminar_paquete(r->pk); free(r->bloques); free(r);
+}
+
+static void resp_enviar(t_st_conn* c, t_st_respuesta* x){
+    if(x->n_bloques == 0){ enviar_paquete(x->pk, c->fd); return; }
+    int* fds = malloc(sizeof(int) * (size_t)x->n_bloques);
+    for(int k=0;k<x->n_bloques;++k) fds[k] = x->bloques[k].fd;
+    enviar_paquete_con_archivos(x->pk, fds, x->n_bloques, (int)g_block_size, c->fd);
+    free(fds);
 }
 
-void handle_worker(int fd){
+// Encola la respuesta en orden de seq y, si nadie está mandando, se queda con
+// el turno y manda todas las que ya estén en orden. El envío (bloqueante) va
+// sin c->mx: quien termina un pedido mientras tanto sólo lo encola y sigue.
+static void conn_responder(t_st_conn* c, t_st_respuesta* r){
+    pthread_mutex_lock(&c->mx);
+    // casi siempre llegan en orden: el lugar está cerca de la cabeza
+    t_st_respuesta** pp = &c->listas;
+    while(*pp && (*pp)->seq < r->seq) pp = &(*pp)->sig;
+    r->sig = *pp; *pp = r;
+    if(c->enviando){ pthread_mutex_unlock(&c->mx); return; }
+    c->enviando = true;
+    while(c->listas && c->listas->seq == c->next_envio){
+        t_st_respuesta* x = c->listas;
+        c->listas = x->sig;
+        c->next_envio++;
+        bool cerrada = c->cerrada;
+        pthread_mutex_unlock(&c->mx);
+        if(!cerrada) resp_enviar(c, x);
+        resp_destruir(x);
+        pthread_mutex_lock(&c->mx);
+    }
+    c->enviando = false;
+    pthread_mutex_unlock(&c->mx);
+}
+
+// ====== Lotes de bloques ======
+// [u32 n][u32 logical x n]; NULL si n no entra en lo que queda del paquete
+static uint32_t* read_logicals(t_paquete* pk, uint32_t* n){
+    *n = read_u32(pk);
+    if(*n > (uint32_t)(pk->buffer->size - pk->buffer->offset) / sizeof(uint32_t)) return NULL;
+    uint32_t* v = malloc((*n?*n:1) * sizeof(uint32_t));
+    for(uint32_t i=0;i<*n;++i) v[i] = read_u32(pk);
+    return v;
+}
+// [u32 len][n*len bytes]: punteros directo al stream del paquete; NULL si no entra
+static const char** read_datas(t_paquete* pk, uint32_t n, uint32_t* len){
+    *len = read_u32(pk);
+    if(n && (uint64_t)n * *len > (uint64_t)(pk->buffer->size - pk->buffer->offset)) return NULL;
+    const char** datas = malloc((n?n:1) * sizeof(char*));
+    for(uint32_t i=0;i<n;++i){
+        datas[i] = pk->buffer->stream+pk->buffer->offset;
+        pk->buffer->offset += *len;
+    }
+    return datas;
+}
+// [id][status] y, si salió bien, los n bloques pineados detrás
+static t_st_respuesta* resp_bloques(int opcode, uint32_t req_id, uint32_t st, uint32_t n, t_bloque_pin* out){
+    if(st!=STATUS_OK){ free(out); return resp_status(opcode, req_id, st); }
+    for(uint32_t i=0;i<n;++i) delay_block();
+    t_st_respuesta* r = resp_status(opcode, req_id, st);
+    r->bloques = out; r->n_bloques = (int)n;
+    return r;
+}
+
+// ====== Handles de la conexión ======
+// Cada handle mantiene una referencia a la entrada del File:Tag. Los números
+// salen de un contador y no se reusan: un pedido *_H que llega después del
+// CLOSE (el pool puede reordenarlos) encuentra ERR_NO_PERMITIDO y no pisa
+// otro File:Tag que haya recibido el mismo número.
+static uint32_t handle_hash(uint32_t h){ return h * 2654435761u; }
+
+// slot de h o NULL (con c->mx tomado)
+static t_st_handle* handle_buscar(t_st_conn* c, uint32_t h){
+    if(!c->cap_handles || h == 0) return NULL;
+    uint32_t m = c->cap_handles - 1;
+    for(uint32_t i = handle_hash(h) & m;; i = (i+1) & m){
+        if(c->handles[i].h == 0) return NULL;
+        if(c->handles[i].h == h) return c->handles[i].e ? &c->handles[i] : NULL;
+    }
+}
+static void handle_insertar(t_st_conn* c, uint32_t h, t_tag_entry* e){
+    uint32_t m = c->cap_handles - 1;
+    uint32_t i = handle_hash(h) & m;
+    while(c->handles[i].h) i = (i+1) & m;
+    c->handles[i].h = h; c->handles[i].e = e;
+    c->n_handles++;
+}
+// con carga 1/2 (contando borrados) se rehashea; sólo se copian los vivos
+static void handles_crecer(t_st_conn* c){
+    t_st_handle* viejos = c->handles;
+    uint32_t cap_vieja = c->cap_handles, vivos = 0;
+    for(uint32_t i=0;i<cap_vieja;++i) if(viejos[i].e) vivos++;
+    uint32_t cap = 16;
+    while(cap < 4*(vivos+1)) cap *= 2;
+    c->handles = calloc(cap, sizeof(t_st_handle));
+    c->cap_handles = cap; c->n_handles = 0;
+    for(uint32_t i=0;i<cap_vieja;++i) if(viejos[i].e) handle_insertar(c, viejos[i].h, viejos[i].e);
+    free(viejos);
+}
+
+static uint32_t conn_handle_abrir(t_st_conn* c, t_tag_entry* e){
+    pthread_mutex_lock(&c->mx);
+    if(2*(c->n_handles+1) > c->cap_handles) handles_crecer(c);
+    if(++c->next_handle == 0) c->next_handle = 1; // 0 no es un handle válido
+    uint32_t h = c->next_handle;
+    handle_insertar(c, h, e);
+    pthread_mutex_unlock(&c->mx);
+    return h;
+}
+// referencia propia para usarla durante el pedido (tag_unref al terminar); NULL si no existe
+static t_tag_entry* conn_handle_tomar(t_st_conn* c, uint32_t h){
+    pthread_mutex_lock(&c->mx);
+    t_st_handle* x = handle_buscar(c, h);
+    t_tag_entry* e = x ? x->e : NULL;
+    if(e) tag_acquire(e);
+    pthread_mutex_unlock(&c->mx);
+    return e;
+}
+static bool conn_handle_cerrar(t_st_conn* c, uint32_t h){
+    pthread_mutex_lock(&c->mx);
+    t_st_handle* x = handle_buscar(c, h);
+    t_tag_entry* e = x ? x->e : NULL;
+    if(x) x->e = NULL; // queda borrado: el número no vuelve a salir
+    pthread_mutex_unlock(&c->mx);
+    if(e) tag_unref(e);
+    return e != NULL;
+}
+
+static t_st_respuesta* ejecutar_pedido(t_st_conn* c, int op, uint32_t req_id, t_paquete* pk){
+    // OPEN/CLOSE sólo tocan la tabla de handles: no pagan el retardo de operación
+    if(op != STORAGE_OPEN && op != STORAGE_CLOSE) delay_op();
+
+    switch(op){
+    case STORAGE_CREATE: {
+        char* file = read_cstring(pk); char* tag = read_cstring(pk);
+        uint32_t st = op_create(0, file, tag);
+        free(file); free(tag);
+        return resp_status(STORAGE_CREATE, req_id, st);
+    }
+
+    case STORAGE_TRUNCATE: {
+        char* file = read_cstring(pk); char* tag = read_cstring(pk);
+        uint32_t new_size = read_u32(pk);
+        uint32_t st = op_truncate(0, file, tag, new_size);
+        free(file); free(tag);
+        return resp_status(STORAGE_TRUNCATE, req_id, st);
+    }
+
+    case STORAGE_DELETE: {
+        char* file = read_cstring(pk); char* tag = read_cstring(pk);
+        uint32_t st = op_delete(0, file, tag);
+        free(file); free(tag);
+        return resp_status(STORAGE_DELETE, req_id, st);
+    }
+
+    case STORAGE_COMMIT: {
+        char* file = read_cstring(pk); char* tag = read_cstring(pk);
+        uint32_t st = op_commit(0, file, tag);
+        free(file); free(tag);
+        return resp_status(STORAGE_COMMIT, req_id, st);
+    }
+
+    case STORAGE_TAG: {
+        char* fsrc = read_cstring(pk); char* tsrc = read_cstring(pk);
+        char* fdst = read_cstring(pk); char* tdst = read_cstring(pk);
+        uint32_t st = op_tag(0, fsrc, tsrc, fdst, tdst);
+        free(fsrc); free(tsrc); free(fdst); free(tdst);
+        return resp_status(STORAGE_TAG, req_id, st);
+    }
+
+    case STORAGE_GET_BLOCK: {
+        char* file = read_cstring(pk); char* tag = read_cstring(pk);
+        uint32_t logical = read_u32(pk);
+        t_bloque_pin* out = malloc(sizeof(*out));
+        uint32_t st = op_get_block(0, file, tag, logical, out);
+        free(file); free(tag);
+        if(st!=STATUS_OK){ free(out); return resp_status(STORAGE_GET_BLOCK, req_id, st); }
+        delay_block();
+        // RESPUESTA: opcode STORAGE_GET_BLOCK + id + exactamente BLOCK_SIZE bytes (sendfile del bloque físico)
+        t_st_respuesta* r = calloc(1, sizeof(*r));
+        r->pk = crear_paquete_con_capacidad(STORAGE_GET_BLOCK, sizeof(uint32_t));
+        agregar_a_paquete(r->pk, &req_id, sizeof(uint32_t));
+        r->bloques = out; r->n_bloques = 1;
+        return r;
+    }
+
+    case STORAGE_PUT_BLOCK: {
+        char* file = read_cstring(pk); char* tag = read_cstring(pk);
+        uint32_t logical = read_u32(pk);
+        uint32_t len = read_u32(pk);
+        // el bloque se usa directo desde el stream del paquete
+        const char* data = pk->buffer->stream+pk->buffer->offset;
+        pk->buffer->offset += len;
+
+        delay_block();
+        uint32_t st = op_put_block(0, file, tag, logical, data, len);
+        free(file); free(tag);
+        return resp_status(STORAGE_PUT_BLOCK, req_id, st);
+    }
+
+    case STORAGE_GET_BLOCKS: {
+        // [file][tag][u32 n][u32 logical x n] -> [id][status] + n*BLOCK_SIZE bytes si OK
+        char* file = read_cstring(pk); char* tag = read_cstring(pk);
+        uint32_t n; uint32_t* logicals = read_logicals(pk, &n);
+        if(!logicals){ free(file); free(tag); return resp_status(STORAGE_GET_BLOCKS, req_id, ERR_NO_PERMITIDO); }
+        t_bloque_pin* out = malloc((n?n:1) * sizeof(*out));
+        uint32_t st = op_get_blocks(0, file, tag, n, logicals, out);
+        free(file); free(tag); free(logicals);
+        return resp_bloques(STORAGE_GET_BLOCKS, req_id, st, n, out);
+    }
+
+    case STORAGE_PUT_BLOCKS: {
+        // [file][tag][u32 n][u32 logical x n][u32 len][n*len bytes] -> [id][status]
+        char* file = read_cstring(pk); char* tag = read_cstring(pk);
+        uint32_t n, len; uint32_t* logicals = read_logicals(pk, &n);
+        const char** datas = logicals ? read_datas(pk, n, &len) : NULL;
+        if(!datas){ free(file); free(tag); free(logicals); return resp_status(STORAGE_PUT_BLOCKS, req_id, ERR_NO_PERMITIDO); }
+        for(uint32_t i=0;i<n;++i) delay_block();
+        uint32_t st = op_put_blocks(0, file, tag, n, logicals, datas, len);
+        free(file); free(tag); free(logicals); free(datas);
+        return resp_status(STORAGE_PUT_BLOCKS, req_id, st);
+    }
+
+    case STORAGE_OPEN: {
+        // [file][tag] -> [id][status][u32 handle]
+        char* file = read_cstring(pk); char* tag = read_cstring(pk);
+        t_tag_entry* e = NULL;
+        uint32_t st = op_open(0, file, tag, &e);
+        free(file); free(tag);
+        uint32_t h = (st==STATUS_OK) ? conn_handle_abrir(c, e) : 0;
+        t_st_respuesta* r = resp_status(STORAGE_OPEN, req_id, st);
+        agregar_a_paquete(r->pk, &h, sizeof(uint32_t));
+        return r;
+    }
+
+    case STORAGE_CLOSE: {
+        uint32_t h = read_u32(pk);
+        return resp_status(STORAGE_CLOSE, req_id, conn_handle_cerrar(c, h) ? STATUS_OK : ERR_NO_PERMITIDO);
+    }
+
+    case STORAGE_GET_BLOCKS_H: {
+        // [u32 handle][u32 n][u32 logical x n] -> igual que GET_BLOCKS
+        t_tag_entry* e = conn_handle_tomar(c, read_u32(pk));
+        uint32_t n; uint32_t* logicals = e ? read_logicals(pk, &n) : NULL;
+        if(!logicals){ if(e) tag_unref(e); return resp_status(STORAGE_GET_BLOCKS_H, req_id, ERR_NO_PERMITIDO); }
+        t_bloque_pin* out = malloc((n?n:1) * sizeof(*out));
+        uint32_t st = op_get_blocks_h(0, e, n, logicals, out);
+        tag_unref(e); free(logicals);
+        return resp_bloques(STORAGE_GET_BLOCKS_H, req_id, st, n, out);
+    }
+
+    case STORAGE_PUT_BLOCKS_H: {
+        // [u32 handle][u32 n][u32 logical x n][u32 len][n*len bytes] -> [id][status]
+        t_tag_entry* e = conn_handle_tomar(c, read_u32(pk));
+        uint32_t n, len; uint32_t* logicals = e ? read_logicals(pk, &n) : NULL;
+        const char** datas = logicals ? read_datas(pk, n, &len) : NULL;
+        if(!datas){ if(e) tag_unref(e); free(logicals); return resp_status(STORAGE_PUT_BLOCKS_H, req_id, ERR_NO_PERMITIDO); }
+        for(uint32_t i=0;i<n;++i) delay_block();
+        uint32_t st = op_put_blocks_h(0, e, n, logicals, datas, len);
+        tag_unref(e); free(logicals); free(datas);
+        return resp_status(STORAGE_PUT_BLOCKS_H, req_id, st);
+    }
+
+    default:
+        // opcode desconocido: igual se responde para no trabar el orden
+        return resp_status(op, req_id, ERR_NO_PERMITIDO);
+    }
+}
+
+// ====== Pool de hilos de operación ======
+static t_queue*        g_pedidos = NULL;
+static pthread_mutex_t m_pedidos = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  c_pedidos = PTHREAD_COND_INITIALIZER;
+
+static void* op_thread(void* _){
+    (void)_;
     for(;;){
-        int op = recibir_operacion(fd);
-        if(op <= 0){
-            // desconectado
-            pthread_mutex_lock(&m_workers);
-            for(int i=0;i<list_size(g_workers);++i){ if((intptr_t)list_get(g_workers,i)==fd){ list_remove(g_workers,i); break; } }
-            int cant=list_size(g_workers); pthread_mutex_unlock(&m_workers);
-            log_worker_desconectado(0, cant); // WorkerID desconocido → 0
-            close(fd);
-            return;
-        }
-        t_paquete* pk = recibir_paquete(fd);
-        if(!pk){ close(fd); return; }
-        pk->buffer->offset = 0;
-
-        delay_op();
-
-        switch(op){
-        case STORAGE_CREATE: {
-            char* file = read_cstring(pk); char* tag = read_cstring(pk);
-            uint32_t st = op_create(0, file, tag);
-            respond_status(fd, STORAGE_CREATE, st);
-            free(file); free(tag);
-        } break;
-
-        case STORAGE_TRUNCATE: {
-            char* file = read_cstring(pk); char* tag = read_cstring(pk);
-            uint32_t new_size = read_u32(pk);
-            uint32_t st = op_truncate(0, file, tag, new_size);
-            respond_status(fd, STORAGE_TRUNCATE, st);
-            free(file); free(tag);
-        } break;
-
-        case STORAGE_DELETE: {
-            char* file = read_cstring(pk); char* tag = read_cstring(pk);
-            uint32_t st = op_delete(0, file, tag);
-            respond_status(fd, STORAGE_DELETE, st);
-            free(file); free(tag);
-        } break;
-
-        case STORAGE_COMMIT: {
-            char* file = read_cstring(pk); char* tag = read_cstring(pk);
-            uint32_t st = op_commit(0, file, tag);
-            respond_status(fd, STORAGE_COMMIT, st);
-            free(file); free(tag);
-        } break;
-
-        case STORAGE_TAG: {
-            char* fsrc = read_cstring(pk); char* tsrc = read_cstring(pk);
-            char* fdst = read_cstring(pk); char* tdst = read_cstring(pk);
-            uint32_t st = op_tag(0, fsrc, tsrc, fdst, tdst);
-            respond_status(fd, STORAGE_TAG, st);
-            free(fsrc); free(tsrc); free(fdst); free(tdst);
-        } break;
-
-        case STORAGE_GET_BLOCK: {
-            char* file = read_cstring(pk); char* tag = read_cstring(pk);
-            uint32_t logical = read_u32(pk);
-            char* out=NULL;
-            uint32_t st = op_get_block(0, file, tag, logical, &out);
-            if(st==STATUS_OK){
-                delay_block();
-                // RESPUESTA: opcode STORAGE_GET_BLOCK + exactamente BLOCK_SIZE bytes
-                t_paquete* r = crear_paquete(STORAGE_GET_BLOCK);
-                agregar_a_paquete(r, out, g_block_size);
-                enviar_paquete(r, fd); eliminar_paquete(r);
-                free(out);
-            } else {
-                respond_status(fd, STORAGE_GET_BLOCK, st);
-            }
-            free(file); free(tag);
-        } break;
-
-        case STORAGE_PUT_BLOCK: {
-            char* file = read_cstring(pk); char* tag = read_cstring(pk);
-            uint32_t logical = read_u32(pk);
-            uint32_t len = read_u32(pk);
-            char* data = malloc(len);
-            memcpy(data, pk->buffer->stream+pk->buffer->offset, len);
-            pk->buffer->offset += len;
-
-            delay_block();
-            uint32_t st = op_put_block(0, file, tag, logical, data, len);
-            respond_status(fd, STORAGE_PUT_BLOCK, st);
-            free(file); free(tag); free(data);
-        } break;
-
-        default:
-            // ignorar
-            break;
-        }
+        pthread_mutex_lock(&m_pedidos);
+        while(queue_is_empty(g_pedidos)) pthread_cond_wait(&c_pedidos, &m_pedidos);
+        t_st_pedido* pd = queue_pop(g_pedidos);
+        pthread_mutex_unlock(&m_pedidos);
+
+        t_st_respuesta* r = ejecutar_pedido(pd->conn, pd->op, pd->req_id, pd->pk);
+        r->seq = pd->seq;
+        conn_responder(pd->conn, r);
+        eliminar_paquete(pd->pk);
+        conn_soltar(pd->conn);
+        free(pd);
+    }
+    return NULL;
+}
+
+void storage_pool_iniciar(int hilos){
+    g_pedidos = queue_create();
+    for(int i=0;i<hilos;++i){
+        pthread_t th; pthread_create(&th, NULL, op_thread, NULL); pthread_detach(th);
+    }
+}
+
+// ====== Eventos del reactor ======
+t_st_conn* st_conn_crear(int fd){
+    t_st_conn* c = calloc(1, sizeof(*c));
+    c->fd = fd; c->refs = 1; // la referencia del reactor
+    pthread_mutex_init(&c->mx, NULL);
+    return c;
+}
 
+// Anillos que mandó el Worker en el handshake: el primero es su salida (nuestra
+// entrada) y el segundo su entrada. Si algo no cierra, se cierran los fds y
+// la conexión sigue por el socket.
+static void anillos_del_worker(t_st_conn* c, t_anillo** rx, t_anillo** tx){
+    int fds[2*ANILLO_FDS];
+    int n = conexion_tomar_fds(conexion_de(c->fd), fds, 2*ANILLO_FDS);
+    *rx = (n == 2*ANILLO_FDS) ? anillo_adjuntar(fds) : NULL;
+    *tx = *rx ? anillo_adjuntar(fds + ANILLO_FDS) : NULL;
+    if(*tx) return;
+    int desde = 0;
+    if(*rx){ anillo_destruir(*rx); *rx = NULL; desde = ANILLO_FDS; } // ya cerró los suyos
+    for(int i=desde;i<n;++i) close(fds[i]);
+}
+
+// se queda con pk (lo libera el hilo que ejecuta el pedido)
+bool st_conn_mensaje(t_st_conn* c, int op, t_paquete* pk){
+    if(!c->handshake_ok){
+        // Handshake esperado:
+        if(op != STORAGE_HANDSHAKE){ eliminar_paquete(pk); return false; }
+        // el Worker puede proponer memoria compartida: [u32 1] + fds de sus dos anillos
+        uint32_t pide_shm = 0;
+        if(pk->buffer->size >= (int)sizeof(uint32_t)){ pk->buffer->offset = 0; pide_shm = read_u32(pk); }
         eliminar_paquete(pk);
+        t_anillo *rx = NULL, *tx = NULL;
+        if(pide_shm) anillos_del_worker(c, &rx, &tx);
+        uint32_t shm_ok = rx != NULL;
+
+        // responder BLOCK_SIZE (todavía por el socket)
+        t_paquete* resp = crear_paquete_con_capacidad(STORAGE_BLOCK_SIZE, 2*sizeof(uint32_t));
+        agregar_a_paquete(resp, &g_block_size, sizeof(uint32_t));
+        agregar_a_paquete(resp, &shm_ok, sizeof(uint32_t));
+        enviar_paquete(resp, c->fd); eliminar_paquete(resp);
+        c->handshake_ok = true;
+        if(shm_ok){
+            anillo_modo_eventos(rx);
+            conexion_adjuntar_anillos(conexion_de(c->fd), rx, tx);
+            log_info(g_logger, "Worker conectado por memoria compartida");
+        }
+
+        pthread_mutex_lock(&m_workers); list_add(g_workers, c); int cant=list_size(g_workers); pthread_mutex_unlock(&m_workers);
+        log_worker_conectado(0, cant); // no tenemos WORKER_ID en el protocolo → 0
+        return true;
+    }
+
+    pk->buffer->offset = 0;
+    t_st_pedido* pd = malloc(sizeof(*pd));
+    pd->conn = c; pd->seq = c->next_seq++; pd->op = op;
+    pd->req_id = read_u32(pk);
+    pd->pk = pk;
+
+    __sync_fetch_and_add(&c->refs, 1);
+    pthread_mutex_lock(&m_pedidos);
+    queue_push(g_pedidos, pd);
+    pthread_cond_signal(&c_pedidos);
+    pthread_mutex_unlock(&m_pedidos);
+    return true;
+}
+
+void st_conn_cerrar(t_st_conn* c){
+    if(c->handshake_ok){
+        // desconectado
+        pthread_mutex_lock(&m_workers);
+        list_remove_element(g_workers, c);
+        int cant=list_size(g_workers); pthread_mutex_unlock(&m_workers);
+        log_worker_desconectado(0, cant); // WorkerID desconocido → 0
     }
+    pthread_mutex_lock(&c->mx); c->cerrada = true; pthread_mutex_unlock(&c->mx);
+    conn_soltar(c);
 }
@@ -0,0 +1,68 @@
+#include "storage.h"
+
+// ====== Locks por File:Tag ======
+// Los pedidos de un mismo Worker corren en paralelo: las operaciones sobre un
+// mismo File:Tag se serializan acá para no pisar el metadata.config.
+static t_dictionary*   g_tag_locks = NULL;   // "file:tag" -> t_tag_entry*
+static pthread_mutex_t m_tag_locks = PTHREAD_MUTEX_INITIALIZER;
+
+static t_tag_entry* tag_entry_ref(const char* file, const char* tag){
+    char* key = string_from_format("%s:%s", file, tag);
+    pthread_mutex_lock(&m_tag_locks);
+    if(!g_tag_locks) g_tag_locks = dictionary_create();
+    t_tag_entry* e = dictionary_get(g_tag_locks, key);
+    if(!e){
+        e = calloc(1, sizeof(*e));
+        e->key = key; key = NULL;
+        e->file = strdup(file); e->tag = strdup(tag);
+        e->dir_logico = path_tag_logical_dir(file, tag);
+        pthread_mutex_init(&e->mx, NULL);
+        dictionary_put(g_tag_locks, e->key, e);
+    }
+    e->refs++;
+    pthread_mutex_unlock(&m_tag_locks);
+    free(key);
+    return e;
+}
+
+static void tag_entry_unref(t_tag_entry* e){
+    pthread_mutex_lock(&m_tag_locks);
+    if(--e->refs == 0){
+        dictionary_remove(g_tag_locks, e->key);
+        pthread_mutex_destroy(&e->mx);
+        if(e->meta) meta_destroy(e->meta);
+        free(e->file); free(e->tag); free(e->dir_logico);
+        free(e->key); free(e);
+    }
+    pthread_mutex_unlock(&m_tag_locks);
+}
+
+t_tag_entry* tag_lock(const char* file, const char* tag){
+    t_tag_entry* e = tag_entry_ref(file, tag);
+    pthread_mutex_lock(&e->mx);
+    return e;
+}
+
+// Las operaciones por nombre leen y escriben metadata.config directamente: al
+// soltar el lock se descarta la copia en caché de los handles.
+void tag_unlock(t_tag_entry* e){
+    if(!e) return;
+    if(e->meta){ meta_destroy(e->meta); e->meta = NULL; }
+    pthread_mutex_unlock(&e->mx);
+    tag_entry_unref(e);
+}
+
+// ====== Handles ======
+t_tag_entry* tag_ref(const char* file, const char* tag){ return tag_entry_ref(file, tag); }
+void tag_acquire(t_tag_entry* e){ pthread_mutex_lock(&m_tag_locks); e->refs++; pthread_mutex_unlock(&m_tag_locks); }
+void tag_unref(t_tag_entry* e){ tag_entry_unref(e); }
+void tag_entry_lock(t_tag_entry* e){ pthread_mutex_lock(&e->mx); }
+void tag_entry_unlock(t_tag_entry* e){ pthread_mutex_unlock(&e->mx); }
+
+// Dos File:Tag a la vez (TAG): siempre en el mismo orden para no trabarse
+void tag_lock_pair(const char* f1, const char* t1, const char* f2, const char* t2, t_tag_entry** e1, t_tag_entry** e2){
+    int cmp = strcmp(f1, f2); if(cmp == 0) cmp = strcmp(t1, t2);
+    if(cmp == 0){ *e1 = tag_lock(f1, t1); *e2 = NULL; return; }
+    if(cmp < 0){ *e1 = tag_lock(f1, t1); *e2 = tag_lock(f2, t2); }
+    else       { *e2 = tag_lock(f2, t2); *e1 = tag_lock(f1, t1); }
+}
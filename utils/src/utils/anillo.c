@@ -0,0 +1,254 @@
+#define _GNU_SOURCE // memfd_create, POLLRDHUP
+#include "anillo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+static void avisar(int ev, _Atomic int *esperando)
+{
+	if (!atomic_load(esperando))
+		return;
+	uint64_t uno = 1;
+	ssize_t r;
+	do
+		r = write(ev, &uno, sizeof(uno));
+	while (r < 0 && errno == EINTR);
+}
+
+static void vaciar_evento(int ev)
+{
+	uint64_t v;
+	while (read(ev, &v, sizeof(v)) > 0)
+		;
+}
+
+// Espera hasta que haya novedades en `ev` o se cierre el socket de control.
+static int esperar(int ev, int vigilar)
+{
+	struct pollfd p[2] = {{.fd = ev, .events = POLLIN}, {.fd = vigilar, .events = POLLRDHUP}};
+	int n;
+	do
+		n = poll(p, vigilar >= 0 ? 2 : 1, -1);
+	while (n < 0 && errno == EINTR);
+	if (n < 0)
+		return -1;
+	if (vigilar >= 0 && (p[1].revents & (POLLRDHUP | POLLHUP | POLLERR)))
+		return -1;
+	vaciar_evento(ev);
+	return 0;
+}
+
+static t_anillo *mapear(int memfd, int ev_datos, int ev_espacio, uint32_t capacidad)
+{
+	size_t total = sizeof(t_anillo_shm) + capacidad;
+	void *m = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if (m == MAP_FAILED)
+		return NULL;
+	t_anillo *a = calloc(1, sizeof(t_anillo));
+	a->shm = m;
+	a->mapeado = total;
+	a->capacidad = capacidad;
+	a->memfd = memfd;
+	a->ev_datos = ev_datos;
+	a->ev_espacio = ev_espacio;
+	return a;
+}
+
+t_anillo *anillo_crear(uint32_t capacidad)
+{
+	size_t total = sizeof(t_anillo_shm) + capacidad;
+	int memfd = memfd_create("anillo", MFD_CLOEXEC);
+	if (memfd < 0)
+		return NULL;
+	int ev_datos = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	int ev_espacio = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	t_anillo *a = NULL;
+	if (ev_datos >= 0 && ev_espacio >= 0 && ftruncate(memfd, (off_t)total) == 0)
+		a = mapear(memfd, ev_datos, ev_espacio, capacidad);
+	if (!a)
+	{
+		close(memfd);
+		if (ev_datos >= 0)
+			close(ev_datos);
+		if (ev_espacio >= 0)
+			close(ev_espacio);
+		return NULL;
+	}
+	a->shm->capacidad = capacidad; // memfd arranca en cero: contadores y flags ya están en 0
+	return a;
+}
+
+// Lado que recibió los fds por SCM_RIGHTS. La capacidad de la cabecera sólo
+// se acepta si coincide con el tamaño real del memfd menos la cabecera.
+t_anillo *anillo_adjuntar(const int fds[ANILLO_FDS])
+{
+	t_anillo_shm cabecera;
+	struct stat st;
+	if (pread(fds[0], &cabecera, sizeof(cabecera), 0) != (ssize_t)sizeof(cabecera))
+		return NULL;
+	if (fstat(fds[0], &st) < 0 || cabecera.capacidad == 0 ||
+		(uint64_t)st.st_size != sizeof(t_anillo_shm) + (uint64_t)cabecera.capacidad)
+		return NULL;
+	return mapear(fds[0], fds[1], fds[2], cabecera.capacidad);
+}
+
+void anillo_fds(t_anillo *a, int fds[ANILLO_FDS])
+{
+	fds[0] = a->memfd;
+	fds[1] = a->ev_datos;
+	fds[2] = a->ev_espacio;
+}
+
+void anillo_destruir(t_anillo *a)
+{
+	if (!a)
+		return;
+	munmap(a->shm, a->mapeado);
+	close(a->memfd);
+	close(a->ev_datos);
+	close(a->ev_espacio);
+	free(a);
+}
+
+// El consumidor deja de bloquearse y pasa a depender siempre del eventfd
+void anillo_modo_eventos(t_anillo *a)
+{
+	a->por_eventos = true;
+	atomic_store(&a->shm->lector_esperando, 1);
+}
+
+// Bytes entre los contadores, acotados a la capacidad: si el otro proceso
+// escribe basura en la cabecera no se copia fuera del anillo.
+static size_t ocupado(uint64_t escrito, uint64_t leido, size_t cap)
+{
+	uint64_t d = escrito - leido;
+	return d > cap ? cap : (size_t)d;
+}
+
+// Espacio contiguo libre a partir de la posición de escritura (espera si no hay)
+static char *reservar(t_anillo *a, size_t *contiguo, int vigilar)
+{
+	t_anillo_shm *s = a->shm;
+	size_t cap = a->capacidad;
+	for (;;)
+	{
+		uint64_t w = atomic_load_explicit(&s->escrito, memory_order_relaxed);
+		size_t libre = cap - ocupado(w, atomic_load(&s->leido), cap);
+		if (libre > 0)
+		{
+			size_t pos = (size_t)(w % cap);
+			*contiguo = (cap - pos < libre) ? cap - pos : libre;
+			return s->datos + pos;
+		}
+		atomic_store(&s->escritor_esperando, 1);
+		bool sigue_lleno = ocupado(w, atomic_load(&s->leido), cap) == cap;
+		int r = sigue_lleno ? esperar(a->ev_espacio, vigilar) : 0;
+		atomic_store(&s->escritor_esperando, 0);
+		if (r < 0)
+			return NULL;
+	}
+}
+
+static void publicar(t_anillo *a, size_t n)
+{
+	atomic_fetch_add(&a->shm->escrito, n);
+	avisar(a->ev_datos, &a->shm->lector_esperando);
+}
+
+int anillo_escribir_iov(t_anillo *a, const struct iovec *iov, int n, int vigilar)
+{
+	int total = 0;
+	for (int i = 0; i < n; i++)
+	{
+		const char *src = iov[i].iov_base;
+		size_t falta = iov[i].iov_len;
+		while (falta > 0)
+		{
+			size_t contiguo;
+			char *dst = reservar(a, &contiguo, vigilar);
+			if (!dst)
+				return -1;
+			size_t k = contiguo < falta ? contiguo : falta;
+			memcpy(dst, src, k);
+			publicar(a, k);
+			src += k;
+			falta -= k;
+			total += (int)k;
+		}
+	}
+	return total;
+}
+
+// pread directo al anillo: el bloque no pasa por un buffer intermedio.
+// Si el archivo es más corto se completa con ceros.
+int anillo_escribir_archivo(t_anillo *a, int fd, size_t len, int vigilar)
+{
+	size_t hecho = 0;
+	while (hecho < len)
+	{
+		size_t contiguo;
+		char *dst = reservar(a, &contiguo, vigilar);
+		if (!dst)
+			return -1;
+		size_t k = contiguo < len - hecho ? contiguo : len - hecho;
+		ssize_t r = pread(fd, dst, k, (off_t)hecho);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0)
+			return -1;
+		if (r == 0)
+		{
+			memset(dst, 0, k);
+			r = (ssize_t)k;
+		}
+		publicar(a, (size_t)r);
+		hecho += (size_t)r;
+	}
+	return (int)hecho;
+}
+
+// Devuelve los bytes copiados, 0 si el otro extremo cerró y -1 con
+// errno == EAGAIN si no había nada y no se pidió bloquear.
+ssize_t anillo_leer(t_anillo *a, void *dst, size_t len, bool bloquear, int vigilar)
+{
+	t_anillo_shm *s = a->shm;
+	size_t cap = a->capacidad;
+	for (;;)
+	{
+		if (a->por_eventos)
+			vaciar_evento(a->ev_datos);
+		uint64_t r = atomic_load_explicit(&s->leido, memory_order_relaxed);
+		size_t hay = ocupado(atomic_load(&s->escrito), r, cap);
+		if (hay > 0)
+		{
+			size_t n = hay < len ? hay : len;
+			size_t pos = (size_t)(r % cap);
+			size_t primero = (cap - pos < n) ? cap - pos : n;
+			memcpy(dst, s->datos + pos, primero);
+			memcpy((char *)dst + primero, s->datos, n - primero);
+			atomic_store(&s->leido, r + n);
+			avisar(a->ev_espacio, &s->escritor_esperando);
+			// el eventfd ya se vació: si quedó algo, que epoll vuelva a avisar
+			if (a->por_eventos && hay > n)
+				avisar(a->ev_datos, &s->lector_esperando);
+			return (ssize_t)n;
+		}
+		if (!bloquear)
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+		atomic_store(&s->lector_esperando, 1);
+		bool sigue_vacio = atomic_load(&s->escrito) == r;
+		int e = sigue_vacio ? esperar(a->ev_datos, vigilar) : 0;
+		if (!a->por_eventos)
+			atomic_store(&s->lector_esperando, 0);
+		if (e < 0)
+			return 0;
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef ANILLO_H_
+#define ANILLO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Anillo de bytes productor/consumidor único en memoria compartida (memfd).
+// Los contadores crecen siempre; la posición es contador % capacidad. Cada
+// lado avisa por eventfd sólo si el otro anunció que está esperando.
+typedef struct {
+	_Alignas(64) _Atomic uint64_t escrito;   // lo mueve el productor
+	_Alignas(64) _Atomic uint64_t leido;     // lo mueve el consumidor
+	_Alignas(64) _Atomic int lector_esperando;
+	_Atomic int escritor_esperando;
+	uint32_t capacidad;
+	_Alignas(64) char datos[];
+} t_anillo_shm;
+
+typedef struct {
+	t_anillo_shm *shm;
+	size_t mapeado;
+	uint32_t capacidad; // copia local: la de la cabecera la puede pisar el otro proceso
+	int memfd;
+	int ev_datos;     // productor -> consumidor
+	int ev_espacio;   // consumidor -> productor
+	bool por_eventos; // el consumidor es un loop con epoll sobre ev_datos
+} t_anillo;
+
+#define ANILLO_FDS 3 // memfd, ev_datos, ev_espacio
+
+t_anillo *anillo_crear(uint32_t capacidad);
+t_anillo *anillo_adjuntar(const int fds[ANILLO_FDS]);
+void anillo_fds(t_anillo *a, int fds[ANILLO_FDS]);
+void anillo_destruir(t_anillo *a);
+void anillo_modo_eventos(t_anillo *a);
+
+// `vigilar` es el socket de control: si el otro extremo lo cierra, las
+// esperas terminan con -1 en lugar de quedar colgadas.
+int anillo_escribir_iov(t_anillo *a, const struct iovec *iov, int n, int vigilar);
+int anillo_escribir_archivo(t_anillo *a, int fd, size_t len, int vigilar);
+ssize_t anillo_leer(t_anillo *a, void *dst, size_t len, bool bloquear, int vigilar);
+
+#endif
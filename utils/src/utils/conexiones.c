@@ -1,12 +1,53 @@
 #define _POSIX_C_SOURCE 200112L  // Habilita POSIX 2001 para addrinfo
 #include "conexiones.h"
+#include "protocolos.h"
 #include <netdb.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 
+// Si el "puerto" es una ruta (tiene '/') se usa un socket AF_UNIX en lugar de
+// TCP: para módulos que corren en el mismo host alcanza con cambiar la config.
+static bool es_ruta_unix(const char* puerto)
+{
+	return puerto && strchr(puerto, '/') != NULL;
+}
+
+static void direccion_unix(struct sockaddr_un* dir, const char* ruta)
+{
+	memset(dir, 0, sizeof(*dir));
+	dir->sun_family = AF_UNIX;
+	strncpy(dir->sun_path, ruta, sizeof(dir->sun_path) - 1);
+}
 
 int iniciar_servidor(char* PUERTO)
 {	
 	int socket_servidor;
 
+	if (es_ruta_unix(PUERTO))
+	{
+		struct sockaddr_un dir;
+		if (strlen(PUERTO) >= sizeof(dir.sun_path))
+			return -1;
+		direccion_unix(&dir, PUERTO);
+		// socket viejo de una corrida anterior; cualquier otro archivo se respeta
+		struct stat st;
+		if (lstat(PUERTO, &st) == 0)
+		{
+			if (!S_ISSOCK(st.st_mode) || unlink(PUERTO) != 0)
+				return -1;
+		}
+		socket_servidor = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (socket_servidor < 0)
+			return -1;
+		if (bind(socket_servidor, (struct sockaddr*)&dir, sizeof(dir)) != 0
+			|| listen(socket_servidor, SOMAXCONN) != 0)
+		{
+			close(socket_servidor);
+			return -1;
+		}
+		return socket_servidor;
+	}
+
 	struct addrinfo hints, *servinfo;
 
 	memset(&hints, 0, sizeof(hints));
@@ -14,14 +55,19 @@ int iniciar_servidor(char* PUERTO)
 	hints.ai_socktype = SOCK_STREAM;
 	hints.ai_flags = AI_PASSIVE;
 	
-	getaddrinfo(NULL, PUERTO, &hints, &servinfo);
+	if (getaddrinfo(NULL, PUERTO, &hints, &servinfo) != 0)
+		return -1;
 
 	socket_servidor = socket(servinfo->ai_family,
                          servinfo->ai_socktype,
                          servinfo->ai_protocol);	
-	bind(socket_servidor, servinfo->ai_addr, servinfo->ai_addrlen);
-	
-	listen(socket_servidor, SOMAXCONN);
+	if (socket_servidor >= 0
+		&& (bind(socket_servidor, servinfo->ai_addr, servinfo->ai_addrlen) != 0
+			|| listen(socket_servidor, SOMAXCONN) != 0))
+	{
+		close(socket_servidor);
+		socket_servidor = -1;
+	}
 
 	freeaddrinfo(servinfo);
 	return socket_servidor;
@@ -29,10 +75,27 @@ int iniciar_servidor(char* PUERTO)
 int esperar_cliente(int socket_servidor)
 {
 	int socket_cliente = accept(socket_servidor, NULL, NULL);
+	conexion_liberar(socket_cliente); // fd reutilizado: que no herede bytes viejos
 	return socket_cliente;
 }
 int crear_conexion(char* ip, char* puerto)
 {
+    if (es_ruta_unix(puerto))
+    {
+        struct sockaddr_un dir;
+        direccion_unix(&dir, puerto);
+        int socket_cliente = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socket_cliente < 0)
+            return -1;
+        if (connect(socket_cliente, (struct sockaddr*)&dir, sizeof(dir)) != 0)
+        {
+            close(socket_cliente);
+            return -1;
+        }
+        conexion_liberar(socket_cliente);
+        return socket_cliente;
+    }
+
     struct addrinfo hints;
     struct addrinfo *server_info;
 
@@ -41,7 +104,8 @@ int crear_conexion(char* ip, char* puerto)
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_flags = AI_PASSIVE;
 
-    getaddrinfo(ip, puerto, &hints, &server_info);
+    if (getaddrinfo(ip, puerto, &hints, &server_info) != 0)
+        return -1;
 
     // Ahora vamos a crear el socket.
     int socket_cliente = socket(server_info->ai_family,
@@ -49,11 +113,30 @@ int crear_conexion(char* ip, char* puerto)
                     server_info->ai_protocol);
 
     // Ahora que tenemos el socket, vamos a conectarlo
-    connect(socket_cliente, server_info->ai_addr, server_info->ai_addrlen);
+    if (socket_cliente < 0 ||
+        connect(socket_cliente, server_info->ai_addr, server_info->ai_addrlen) != 0)
+    {
+        if (socket_cliente >= 0)
+            close(socket_cliente);
+        freeaddrinfo(server_info);
+        return -1;
+    }
 
     freeaddrinfo(server_info);
+    conexion_liberar(socket_cliente);
 
     return socket_cliente;
 }
+bool socket_es_local(int socket)
+{
+	struct sockaddr_storage dir;
+	socklen_t len = sizeof(dir);
+	return getsockname(socket, (struct sockaddr*)&dir, &len) == 0 && dir.ss_family == AF_UNIX;
+}
+void liberar_conexion(int socket)
+{
+    conexion_liberar(socket);
+    close(socket);
+}
 
 
@@ -21,7 +21,9 @@
 #include <semaphore.h>
 #include <pthread.h>
 
-int iniciar_servidor(char*);
+int iniciar_servidor(char*);                    // idem: ruta = AF_UNIX
 int esperar_cliente(int);
-int crear_conexion(char* ip, char* puerto);
+int crear_conexion(char* ip, char* puerto);    // puerto con '/' = socket AF_UNIX
+bool socket_es_local(int socket);               // true si es AF_UNIX (admite SCM_RIGHTS)
+void liberar_conexion(int socket);
 #endif
@@ -1,41 +1,441 @@
 #include "protocolos.h"
+#include <arpa/inet.h>
 #include <netdb.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/sendfile.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024 // mínimo que garantiza Linux para writev
+#endif
 
 t_paquete *crear_paquete(op_code codigo_operacion)
+{
+	return crear_paquete_con_capacidad(codigo_operacion, 0);
+}
+
+// Reserva el stream una sola vez cuando el tamaño final se conoce de antemano
+t_paquete *crear_paquete_con_capacidad(op_code codigo_operacion, int capacidad)
 {
 	t_paquete *paquete = malloc(sizeof(t_paquete));
 	paquete->codigo_operacion = codigo_operacion;
 	paquete->buffer = malloc(sizeof(t_buffer));
 	paquete->buffer->size = 0;
-	paquete->buffer->stream = NULL;
+	paquete->buffer->offset = 0;
+	paquete->buffer->capacidad = capacidad > 0 ? capacidad : 0;
+	paquete->buffer->stream = capacidad > 0 ? malloc(capacidad) : NULL;
 	return paquete;
 }
 
 void agregar_a_paquete(t_paquete *paquete, void *valor, int tamanio)
 {
-	paquete->buffer->stream = realloc(paquete->buffer->stream, paquete->buffer->size + tamanio);
-	memcpy(paquete->buffer->stream + paquete->buffer->size, valor, tamanio);
-	paquete->buffer->size += tamanio;
+	t_buffer *b = paquete->buffer;
+	if (b->size + tamanio > b->capacidad)
+	{
+		int cap = b->capacidad ? b->capacidad : 64;
+		while (cap < b->size + tamanio)
+			cap *= 2;
+		b->stream = realloc(b->stream, cap);
+		b->capacidad = cap;
+	}
+	memcpy(b->stream + b->size, valor, tamanio);
+	b->size += tamanio;
+}
+
+// ====== Transporte ======
+// Los bytes de una conexión viajan por el socket o, si se le adjuntaron
+// anillos de memoria compartida, por los anillos: arriba de esto (paquetes,
+// buffers, epoll) nadie se entera de cuál se usa.
+
+// writev hasta mandar todo; el que llama ya tiene el mutex de envío.
+// Todos los envíos por socket van con MSG_NOSIGNAL: si el otro extremo se
+// fue, el error vuelve como -1/EPIPE en vez de matar al proceso con SIGPIPE.
+static int escribir_iov(t_conexion *c, struct iovec *iov, int iovcnt)
+{
+	if (c->tx)
+		return anillo_escribir_iov(c->tx, iov, iovcnt, c->fd);
+	int total = 0;
+	while (iovcnt > 0)
+	{
+		struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iovcnt < IOV_MAX ? iovcnt : IOV_MAX};
+		ssize_t w = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w < 0)
+			return -1;
+		total += (int)w;
+		while (iovcnt > 0 && (size_t)w >= iov->iov_len)
+		{
+			w -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+	return total;
+}
+
+// fds que llegaron por SCM_RIGHTS: quedan en la conexión hasta que alguien los tome
+static void guardar_fds(t_conexion *c, struct msghdr *msg)
+{
+	for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm))
+	{
+		if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+			continue;
+		int n = (int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		int *fds = (int *)CMSG_DATA(cm);
+		for (int i = 0; i < n; i++)
+		{
+			if (c->n_fds_recibidos < CONEXION_MAX_FDS)
+				c->fds_recibidos[c->n_fds_recibidos++] = fds[i];
+			else
+				close(fds[i]);
+		}
+	}
+}
+
+// Un recv sobre el transporte de la conexión (mismo contrato que recv)
+static ssize_t transporte_recibir(t_conexion *c, void *buf, size_t len, bool bloquear)
+{
+	if (c->rx)
+	{
+		// el socket sólo sirve para enterarse del cierre
+		char b;
+		if (!bloquear && recv(c->fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+			return 0;
+		return anillo_leer(c->rx, buf, len, bloquear, c->fd);
+	}
+	char control[CMSG_SPACE(sizeof(int) * CONEXION_MAX_FDS)];
+	struct iovec iov = {.iov_base = buf, .iov_len = len};
+	struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+	ssize_t r = recvmsg(c->fd, &msg, bloquear ? 0 : MSG_DONTWAIT);
+	if (r > 0 && msg.msg_controllen > 0)
+		guardar_fds(c, &msg);
+	return r;
+}
+
+// ====== Cola de salida ======
+// Para loops con epoll: una conexión vigilada nunca bloquea al que envía. Se
+// escribe lo que el socket acepte y el resto se copia a la cola; el dueño del
+// epoll la vacía con conexion_vaciar_salida cuando llega EPOLLOUT. Mientras
+// haya algo en cola todo lo nuevo va detrás, así no se desordenan mensajes.
+// EPOLLOUT se pide y se suelta con mx_envio tomado, junto con la cola.
+
+// writev sin bloquear hasta que el socket no acepte más; deja en *iov/*iovcnt
+// lo que falta mandar. 0 o -1 si el socket falló.
+static int escribir_sin_bloquear(t_conexion *c, struct iovec **iov, int *iovcnt)
+{
+	while (*iovcnt > 0)
+	{
+		struct msghdr msg = {.msg_iov = *iov, .msg_iovlen = *iovcnt < IOV_MAX ? *iovcnt : IOV_MAX};
+		ssize_t w = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (w < 0)
+			return -1;
+		while (*iovcnt > 0 && (size_t)w >= (*iov)->iov_len)
+		{
+			w -= (*iov)->iov_len;
+			(*iov)++;
+			(*iovcnt)--;
+		}
+		if (*iovcnt > 0)
+		{
+			(*iov)->iov_base = (char *)(*iov)->iov_base + w;
+			(*iov)->iov_len -= w;
+		}
+	}
+	return 0;
+}
+
+static void salida_armar(t_conexion *c, bool armar)
+{
+	if (c->salida_armada == armar)
+		return;
+	struct epoll_event ev = {.events = EPOLLIN | (armar ? EPOLLOUT : 0), .data.ptr = c->salida_dato};
+	epoll_ctl(c->salida_epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	c->salida_armada = armar;
+}
+
+static void salida_agregar(t_conexion *c, const void *datos, size_t len)
+{
+	if (c->salida_fin + len > c->salida_cap && c->salida_ini > 0)
+	{
+		memmove(c->salida, c->salida + c->salida_ini, c->salida_fin - c->salida_ini);
+		c->salida_fin -= c->salida_ini;
+		c->salida_ini = 0;
+	}
+	if (c->salida_fin + len > c->salida_cap)
+	{
+		size_t cap = c->salida_cap ? c->salida_cap : 4096;
+		while (cap < c->salida_fin + len)
+			cap *= 2;
+		c->salida = realloc(c->salida, cap);
+		c->salida_cap = cap;
+	}
+	memcpy(c->salida + c->salida_fin, datos, len);
+	c->salida_fin += len;
+}
+
+// El que llama ya tiene el mutex de envío. -1 si el socket falló o si el otro
+// extremo dejó de leer y la cola llegaría a CONEXION_SALIDA_MAX.
+static int encolar_iov(t_conexion *c, struct iovec *iov, int iovcnt)
+{
+	size_t total = 0;
+	for (int i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+	if (c->salida_ini == c->salida_fin && escribir_sin_bloquear(c, &iov, &iovcnt) < 0)
+		return -1;
+	size_t resto = 0;
+	for (int i = 0; i < iovcnt; i++)
+		resto += iov[i].iov_len;
+	if (c->salida_fin - c->salida_ini + resto > CONEXION_SALIDA_MAX)
+		return -1;
+	for (int i = 0; i < iovcnt; i++)
+		salida_agregar(c, iov[i].iov_base, iov[i].iov_len);
+	if (c->salida_ini != c->salida_fin)
+		salida_armar(c, true);
+	return (int)total;
+}
+
+// Desde acá los envíos a `c` no bloquean: el fd queda O_NONBLOCK y `epfd`
+// (donde ya está registrado con EPOLLIN y data.ptr = `dato`) avisa cuándo
+// se puede seguir vaciando la cola.
+void conexion_vigilar_salida(t_conexion *c, int epfd, void *dato)
+{
+	pthread_mutex_lock(&c->mx_envio);
+	c->salida_epfd = epfd;
+	c->salida_dato = dato;
+	pthread_mutex_unlock(&c->mx_envio);
+	fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Con EPOLLOUT: manda lo que se pueda de la cola. 1 si quedó algo, 0 si se
+// vació (y se suelta EPOLLOUT), -1 si el socket falló.
+int conexion_vaciar_salida(t_conexion *c)
+{
+	pthread_mutex_lock(&c->mx_envio);
+	int r = 0;
+	if (c->salida_ini != c->salida_fin)
+	{
+		size_t pendiente = c->salida_fin - c->salida_ini;
+		struct iovec iov = {.iov_base = c->salida + c->salida_ini, .iov_len = pendiente};
+		struct iovec *v = &iov;
+		int n = 1;
+		if (escribir_sin_bloquear(c, &v, &n) < 0)
+			r = -1; // se descarta la cola: el cierre lo ve la lectura
+		else
+			c->salida_ini += pendiente - (n ? iov.iov_len : 0);
+		if (r < 0 || c->salida_ini == c->salida_fin)
+			c->salida_ini = c->salida_fin = 0;
+		else
+			r = 1;
+	}
+	salida_armar(c, r == 1);
+	pthread_mutex_unlock(&c->mx_envio);
+	return r;
+}
+
+// el mutex de envío evita que dos hilos intercalen pedazos de mensajes
+// distintos sobre el mismo socket.
+static int enviar_iov(int socket_destino, struct iovec *iov, int iovcnt)
+{
+	t_conexion *c = conexion_de(socket_destino);
+	if (!c)
+		return -1;
+	pthread_mutex_lock(&c->mx_envio);
+	int total = (c->salida_epfd >= 0 && !c->tx) ? encolar_iov(c, iov, iovcnt) : escribir_iov(c, iov, iovcnt);
+	pthread_mutex_unlock(&c->mx_envio);
+	return total;
+}
+
+// sendfile de `len` bytes desde el principio del archivo; si el archivo es
+// más corto se completa con ceros para no romper el framing. sendfile no
+// acepta MSG_NOSIGNAL: el módulo que lo usa (Storage) ignora SIGPIPE.
+static int enviar_archivo(t_conexion *c, int fd_archivo, int len)
+{
+	if (c->tx)
+		return anillo_escribir_archivo(c->tx, fd_archivo, (size_t)len, c->fd);
+	off_t offset = 0;
+	int enviados = 0;
+	while (enviados < len)
+	{
+		ssize_t w = sendfile(c->fd, fd_archivo, &offset, (size_t)(len - enviados));
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w < 0)
+			return -1;
+		if (w == 0)
+			break;
+		enviados += (int)w;
+	}
+	static const char ceros[512];
+	while (enviados < len)
+	{
+		int n = (len - enviados) < (int)sizeof(ceros) ? (len - enviados) : (int)sizeof(ceros);
+		struct iovec iov = {.iov_base = (void *)ceros, .iov_len = (size_t)n};
+		if (escribir_iov(c, &iov, 1) < 0)
+			return -1;
+		enviados += n;
+	}
+	return enviados;
 }
 
 int enviar_paquete(t_paquete *paquete, int socket_destino)
 {
-	int bytes = paquete->buffer->size + sizeof(op_code) + sizeof(int);
-	void *a_enviar = malloc(bytes);
-	int offset = 0;
+	return enviar_paquete_con_datos(paquete, NULL, 0, socket_destino);
+}
+
+// Igual que enviar_paquete, pero `datos` viaja a continuación del stream sin
+// copiarse al paquete (bloques de Storage).
+int enviar_paquete_con_datos(t_paquete *paquete, const void *datos, int len, int socket_destino)
+{
+	struct iovec extra = {.iov_base = (void *)datos, .iov_len = len};
+	return enviar_paquete_con_iov(paquete, &extra, len > 0 ? 1 : 0, socket_destino);
+}
+
+// Generalización para lotes: cada iovec extra (p. ej. un frame de memoria)
+// se agrega al cuerpo del mensaje en orden, sin copias intermedias.
+int enviar_paquete_con_iov(t_paquete *paquete, const struct iovec *extra, int n_extra, int socket_destino)
+{
+	int header[2];
+	int total = 0;
+	for (int i = 0; i < n_extra; i++)
+		total += (int)extra[i].iov_len;
+	header[0] = paquete->codigo_operacion;
+	header[1] = paquete->buffer->size + total;
+
+	struct iovec fijos[2];
+	struct iovec *iov = (n_extra > 0) ? malloc(sizeof(struct iovec) * (2 + n_extra)) : fijos;
+	int n = 0;
+	iov[n].iov_base = header;
+	iov[n++].iov_len = sizeof(op_code) + sizeof(int);
+	if (paquete->buffer->size > 0)
+	{
+		iov[n].iov_base = paquete->buffer->stream;
+		iov[n++].iov_len = paquete->buffer->size;
+	}
+	for (int i = 0; i < n_extra; i++)
+		if (extra[i].iov_len > 0)
+			iov[n++] = extra[i];
+
+	int result = enviar_iov(socket_destino, iov, n);
+	if (iov != fijos)
+		free(iov);
+	if (result < 0)
+	{
+		printf("Error al enviar el paquete\n");
+	}
+	return result;
+}
+
+// El cuerpo continúa con `len_cada` bytes de cada archivo, que el kernel pasa
+// directo al socket (sendfile) sin copias en espacio de usuario.
+int enviar_paquete_con_archivos(t_paquete *paquete, const int *fds, int n, int len_cada, int socket_destino)
+{
+	t_conexion *c = conexion_de(socket_destino);
+	if (!c)
+		return -1;
+	int header[2];
+	header[0] = paquete->codigo_operacion;
+	header[1] = paquete->buffer->size + n * len_cada;
+
+	struct iovec iov[2];
+	int k = 0;
+	iov[k].iov_base = header;
+	iov[k++].iov_len = sizeof(op_code) + sizeof(int);
+	if (paquete->buffer->size > 0)
+	{
+		iov[k].iov_base = paquete->buffer->stream;
+		iov[k++].iov_len = paquete->buffer->size;
+	}
 
-	memcpy(a_enviar + offset, &(paquete->codigo_operacion), sizeof(op_code));
-	offset += sizeof(op_code);
-	memcpy(a_enviar + offset, &(paquete->buffer->size), sizeof(int));
-	offset += sizeof(int);
-	memcpy(a_enviar + offset, paquete->buffer->stream, paquete->buffer->size);
+	pthread_mutex_lock(&c->mx_envio);
+	int result = escribir_iov(c, iov, k);
+	for (int i = 0; i < n && result >= 0; i++)
+	{
+		int w = enviar_archivo(c, fds[i], len_cada);
+		result = (w < 0) ? -1 : result + w;
+	}
+	pthread_mutex_unlock(&c->mx_envio);
+	if (result < 0)
+	{
+		printf("Error al enviar el paquete\n");
+	}
+	return result;
+}
+
+// Manda el paquete por el socket adjuntando descriptores (SCM_RIGHTS); el
+// otro extremo los encuentra con conexion_tomar_fds. Sólo para AF_UNIX.
+int enviar_paquete_con_fds(t_paquete *paquete, const int *fds, int n, int socket_destino)
+{
+	t_conexion *c = conexion_de(socket_destino);
+	if (!c || n > CONEXION_MAX_FDS)
+		return -1;
+	int header[2] = {paquete->codigo_operacion, paquete->buffer->size};
+	struct iovec iov[2] = {{.iov_base = header, .iov_len = sizeof(op_code) + sizeof(int)},
+						   {.iov_base = paquete->buffer->stream, .iov_len = paquete->buffer->size}};
+	char control[CMSG_SPACE(sizeof(int) * CONEXION_MAX_FDS)];
+	memset(control, 0, sizeof(control));
+	struct msghdr msg = {.msg_iov = iov, .msg_iovlen = paquete->buffer->size > 0 ? 2 : 1,
+						 .msg_control = control, .msg_controllen = CMSG_SPACE(sizeof(int) * n)};
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(int) * n);
+	memcpy(CMSG_DATA(cm), fds, sizeof(int) * n);
+
+	pthread_mutex_lock(&c->mx_envio);
+	ssize_t w;
+	do
+		w = sendmsg(socket_destino, &msg, MSG_NOSIGNAL);
+	while (w < 0 && errno == EINTR);
+	// los fds ya viajaron con el primer byte; si quedó algo sin mandar va sin control
+	int result = (int)w;
+	if (w >= 0 && (size_t)w < iov[0].iov_len + (msg.msg_iovlen > 1 ? iov[1].iov_len : 0))
+	{
+		size_t resto = (size_t)w;
+		int k = 0;
+		while (resto >= iov[k].iov_len)
+			resto -= iov[k++].iov_len;
+		iov[k].iov_base = (char *)iov[k].iov_base + resto;
+		iov[k].iov_len -= resto;
+		int r = escribir_iov(c, &iov[k], (int)msg.msg_iovlen - k);
+		result = (r < 0) ? -1 : result + r;
+	}
+	pthread_mutex_unlock(&c->mx_envio);
+	if (result < 0)
+	{
+		printf("Error al enviar el paquete\n");
+	}
+	return result;
+}
 
-	int result = send(socket_destino, a_enviar, bytes, 0);
+// Reenvía el cuerpo de un paquete recibido desde el byte `desde` con otro
+// código de operación: sólo se arma una cabecera nueva y el resto sale del
+// mismo stream por writev, sin deserializarlo. En una conexión con cola de
+// salida va detrás de lo encolado (y sólo se copia lo que no entró).
+int reenviar_paquete(t_paquete *paquete, op_code op, int desde, int socket_destino)
+{
+	if (desde < 0 || desde > paquete->buffer->size)
+		return -1;
+	int header[2] = {op, paquete->buffer->size - desde};
+	struct iovec iov[2] = {
+		{.iov_base = header, .iov_len = sizeof(op_code) + sizeof(int)},
+		{.iov_base = (char *)paquete->buffer->stream + desde, .iov_len = (size_t)header[1]}};
+	int result = enviar_iov(socket_destino, iov, header[1] > 0 ? 2 : 1);
 	if (result < 0)
 	{
 		printf("Error al enviar el paquete\n");
 	}
-	free(a_enviar);
 	return result;
 }
 
@@ -51,22 +451,328 @@ void buffer_read(void* dest, t_buffer* buffer, int size) {
     buffer->offset += size;
 }
 
+// ====== Strings en los mensajes de Master ======
+// Un solo formato para QC, Master y Worker: [int32 en orden de red][n bytes]
+// sin '\0'. Así el Master puede reenviar un cuerpo tal cual lo recibió.
+void agregar_string_a_paquete(t_paquete *paquete, const char *s)
+{
+	int32_t n = s ? (int32_t)strlen(s) : 0;
+	int32_t n_net = htonl(n);
+	agregar_a_paquete(paquete, &n_net, sizeof(n_net));
+	if (n > 0)
+		agregar_a_paquete(paquete, (void *)s, n);
+}
+
+// NULL si el string no entra en lo que queda del buffer
+char *leer_string_de_paquete(t_paquete *paquete)
+{
+	t_buffer *b = paquete->buffer;
+	int32_t n_net = 0;
+	if (b->size - b->offset < (int)sizeof(n_net))
+		return NULL;
+	buffer_read(&n_net, b, sizeof(n_net));
+	int32_t n = ntohl(n_net);
+	if (n < 0 || n > b->size - b->offset)
+		return NULL;
+	char *s = malloc((size_t)n + 1);
+	memcpy(s, (char *)b->stream + b->offset, (size_t)n);
+	s[n] = '\0';
+	b->offset += n;
+	return s;
+}
+
+// ====== Resumen de caché ======
+// Worker y Master sólo comparten el hash de "file:tag" (FNV-1a); el filtro
+// usa 3 posiciones derivadas de él (doble hashing), ~1% de falsos positivos
+// con un par de cientos de File:Tags distintos en memoria.
+uint32_t hash_file_tag(const char *file, const char *tag)
+{
+	uint32_t h = 2166136261u;
+	for (const char *p = file; *p; p++)
+		h = (h ^ (uint8_t)*p) * 16777619u;
+	h = (h ^ (uint8_t)':') * 16777619u;
+	for (const char *p = tag; *p; p++)
+		h = (h ^ (uint8_t)*p) * 16777619u;
+	return h;
+}
+
+static uint32_t resumen_bit(uint32_t h, int i)
+{
+	uint32_t h2 = (h >> 16) | (h << 16) | 1;
+	return (h + (uint32_t)i * h2) % (RESUMEN_CACHE_BYTES * 8);
+}
+
+void resumen_agregar(uint8_t *resumen, uint32_t h)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		uint32_t b = resumen_bit(h, i);
+		resumen[b / 8] |= (uint8_t)(1u << (b % 8));
+	}
+}
+
+bool resumen_contiene(const uint8_t *resumen, uint32_t h)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		uint32_t b = resumen_bit(h, i);
+		if (!(resumen[b / 8] & (1u << (b % 8))))
+			return false;
+	}
+	return true;
+}
+
+// ====== Lectura con buffer por socket ======
+static pthread_mutex_t m_conexiones = PTHREAD_MUTEX_INITIALIZER;
+static t_conexion **g_conexiones = NULL;
+static int g_conexiones_cap = 0;
+
+t_conexion *conexion_de(int fd)
+{
+	if (fd < 0)
+		return NULL;
+	pthread_mutex_lock(&m_conexiones);
+	if (fd >= g_conexiones_cap)
+	{
+		int cap = g_conexiones_cap ? g_conexiones_cap : 64;
+		while (cap <= fd)
+			cap *= 2;
+		g_conexiones = realloc(g_conexiones, cap * sizeof(t_conexion *));
+		memset(g_conexiones + g_conexiones_cap, 0, (cap - g_conexiones_cap) * sizeof(t_conexion *));
+		g_conexiones_cap = cap;
+	}
+	t_conexion *c = g_conexiones[fd];
+	if (!c)
+	{
+		c = calloc(1, sizeof(t_conexion));
+		c->fd = fd;
+		c->capacidad = CONEXION_BUFFER_INICIAL;
+		c->buffer = malloc(c->capacidad);
+		c->salida_epfd = -1;
+		pthread_mutex_init(&c->mx_envio, NULL);
+		g_conexiones[fd] = c;
+	}
+	pthread_mutex_unlock(&m_conexiones);
+	return c;
+}
+
+// Descarta lo que haya quedado en el buffer del socket (se llama antes del
+// close y también al aceptar/crear un socket, por si el fd se reutiliza).
+void conexion_liberar(int fd)
+{
+	if (fd < 0)
+		return;
+	pthread_mutex_lock(&m_conexiones);
+	if (fd < g_conexiones_cap && g_conexiones[fd])
+	{
+		t_conexion *c = g_conexiones[fd];
+		pthread_mutex_destroy(&c->mx_envio);
+		anillo_destruir(c->rx);
+		anillo_destruir(c->tx);
+		for (int i = 0; i < c->n_fds_recibidos; i++)
+			close(c->fds_recibidos[i]);
+		free(c->salida);
+		free(g_conexiones[fd]->buffer);
+		free(g_conexiones[fd]);
+		g_conexiones[fd] = NULL;
+	}
+	pthread_mutex_unlock(&m_conexiones);
+}
+
+// Asegura al menos `necesarios` bytes en el buffer. Cada recv() pide todo el
+// espacio libre, así que normalmente llegan varios mensajes de una vez.
+static int conexion_llenar(t_conexion *c, size_t necesarios)
+{
+	if (c->fin - c->inicio >= necesarios)
+		return 0;
+	if (c->capacidad - c->inicio < necesarios)
+	{
+		memmove(c->buffer, c->buffer + c->inicio, c->fin - c->inicio);
+		c->fin -= c->inicio;
+		c->inicio = 0;
+	}
+	while (c->fin - c->inicio < necesarios)
+	{
+		ssize_t r = transporte_recibir(c, c->buffer + c->fin, c->capacidad - c->fin, true);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return -1;
+		c->fin += (size_t)r;
+	}
+	return 0;
+}
+
+int conexion_recibir_operacion(t_conexion *c)
+{
+	op_code codigo_operacion;
+	if (!c || conexion_llenar(c, sizeof(op_code)) < 0)
+		return -1;
+	memcpy(&codigo_operacion, c->buffer + c->inicio, sizeof(op_code));
+	c->inicio += sizeof(op_code);
+	return codigo_operacion;
+}
+
+t_paquete *conexion_recibir_paquete(t_conexion *c)
+{
+	int size = 0;
+	if (!c || conexion_llenar(c, sizeof(int)) < 0)
+		return NULL;
+	memcpy(&size, c->buffer + c->inicio, sizeof(int));
+	if (size < 0 || size > CONEXION_PAQUETE_MAX)
+	{
+		c->invalida = true;
+		return NULL;
+	}
+	c->inicio += sizeof(int);
+
+	t_paquete *paquete = malloc(sizeof(t_paquete));
+	paquete->buffer = malloc(sizeof(t_buffer));
+	paquete->buffer->size = size;
+	paquete->buffer->offset = 0;
+	paquete->buffer->capacidad = size;
+	paquete->buffer->stream = malloc(size);
+
+	if ((size_t)size <= c->capacidad)
+	{
+		if (conexion_llenar(c, (size_t)size) < 0)
+		{
+			eliminar_paquete(paquete);
+			return NULL;
+		}
+		memcpy(paquete->buffer->stream, c->buffer + c->inicio, size);
+		c->inicio += size;
+	}
+	else
+	{
+		// Más grande que el buffer: lo que ya llegó se copia y el resto va directo
+		size_t copiado = c->fin - c->inicio;
+		memcpy(paquete->buffer->stream, c->buffer + c->inicio, copiado);
+		c->inicio = c->fin = 0;
+		while (copiado < (size_t)size)
+		{
+			ssize_t r = transporte_recibir(c, (char *)paquete->buffer->stream + copiado, size - copiado, true);
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r <= 0)
+			{
+				eliminar_paquete(paquete);
+				return NULL;
+			}
+			copiado += (size_t)r;
+		}
+	}
+	return paquete;
+}
+
+// ====== Lectura no bloqueante (para loops con epoll) ======
+// Un solo recv() (o lectura del anillo) con lo que haya disponible. Devuelve
+// los bytes leídos, 0 si el otro extremo cerró y -1 en error (errno == EAGAIN
+// si no había nada).
+int conexion_leer_disponible(t_conexion *c)
+{
+	if (c->inicio > 0 && c->fin == c->capacidad)
+	{
+		memmove(c->buffer, c->buffer + c->inicio, c->fin - c->inicio);
+		c->fin -= c->inicio;
+		c->inicio = 0;
+	}
+	if (c->fin == c->capacidad)
+	{
+		char *nuevo = realloc(c->buffer, c->capacidad * 2);
+		if (!nuevo)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+		c->buffer = nuevo;
+		c->capacidad *= 2;
+	}
+	ssize_t r;
+	do
+		r = transporte_recibir(c, c->buffer + c->fin, c->capacidad - c->fin, false);
+	while (r < 0 && errno == EINTR);
+	if (r > 0)
+		c->fin += (size_t)r;
+	return (int)r;
+}
+
+// Si en el buffer hay un mensaje completo lo devuelve (y lo consume); si no, NULL.
+// Un tamaño negativo o mayor a CONEXION_PAQUETE_MAX (o no poder reservar el
+// buffer) deja la conexión `invalida`: el que llama tiene que cerrarla.
+t_paquete *conexion_extraer_paquete(t_conexion *c, int *op)
+{
+	size_t header = sizeof(op_code) + sizeof(int);
+	if (c->fin - c->inicio < header)
+		return NULL;
+	op_code codigo;
+	int size;
+	memcpy(&codigo, c->buffer + c->inicio, sizeof(op_code));
+	memcpy(&size, c->buffer + c->inicio + sizeof(op_code), sizeof(int));
+	if (size < 0 || size > CONEXION_PAQUETE_MAX)
+	{
+		c->invalida = true; // el que llama cierra la conexión
+		return NULL;
+	}
+	if (c->fin - c->inicio < header + (size_t)size)
+	{
+		// el mensaje no entra: agrandar para que el próximo recv pueda completarlo
+		if (c->capacidad < header + (size_t)size)
+		{
+			memmove(c->buffer, c->buffer + c->inicio, c->fin - c->inicio);
+			c->fin -= c->inicio;
+			c->inicio = 0;
+			char *nuevo = realloc(c->buffer, header + (size_t)size);
+			if (!nuevo)
+			{
+				c->invalida = true;
+				return NULL;
+			}
+			c->buffer = nuevo;
+			c->capacidad = header + (size_t)size;
+		}
+		return NULL;
+	}
+
+	t_paquete *paquete = crear_paquete_con_capacidad(codigo, size);
+	memcpy(paquete->buffer->stream, c->buffer + c->inicio + header, size);
+	paquete->buffer->size = size;
+	c->inicio += header + (size_t)size;
+	if (c->inicio == c->fin)
+		c->inicio = c->fin = 0;
+	*op = codigo;
+	return paquete;
+}
+
+int conexion_tomar_fds(t_conexion *c, int *out, int max)
+{
+	int n = c->n_fds_recibidos < max ? c->n_fds_recibidos : max;
+	memcpy(out, c->fds_recibidos, sizeof(int) * n);
+	memmove(c->fds_recibidos, c->fds_recibidos + n, sizeof(int) * (c->n_fds_recibidos - n));
+	c->n_fds_recibidos -= n;
+	return n;
+}
+
+// A partir de acá los mensajes de la conexión van por los anillos. Tiene que
+// llamarse con el canal quieto (ningún mensaje a medio mandar ni en vuelo).
+void conexion_adjuntar_anillos(t_conexion *c, t_anillo *rx, t_anillo *tx)
+{
+	pthread_mutex_lock(&c->mx_envio);
+	c->rx = rx;
+	c->tx = tx;
+	pthread_mutex_unlock(&c->mx_envio);
+}
+
+// fd para registrar en epoll cuando la conexión lee de un anillo (-1 si no)
+int conexion_fd_evento(t_conexion *c)
+{
+	return c->rx ? c->rx->ev_datos : -1;
+}
+
 t_paquete* recibir_paquete(int socket) 
 {
-    t_paquete* paquete = malloc(sizeof(t_paquete));
-    paquete->buffer = malloc(sizeof(t_buffer));
-    // Recibir el tamaño del buffer
-    recv(socket, &paquete->buffer->size, sizeof(int), 0);
-    // Recibir el buffer
-    paquete->buffer->stream = malloc(paquete->buffer->size);
-    recv(socket, paquete->buffer->stream, paquete->buffer->size, 0);
-    return paquete;
+    return conexion_recibir_paquete(conexion_de(socket));
 }
 int recibir_operacion(int cliente_fd) {
-    op_code codigo_operacion;
-    int bytes_recibidos = recv(cliente_fd, &codigo_operacion, sizeof(op_code), 0);
-    if (bytes_recibidos <= 0) {
-        return -1;
-    }
-    return codigo_operacion;
+    return conexion_recibir_operacion(conexion_de(cliente_fd));
 }
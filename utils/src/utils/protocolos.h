@@ -8,6 +8,7 @@
 #include <signal.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <string.h>
 #include <readline/readline.h>
 #include <commons/log.h>
@@ -19,6 +20,7 @@
 #include <stdbool.h>
 #include <semaphore.h>
 #include <pthread.h>
+#include "anillo.h"
 
 typedef enum {
     // ---------------- Handshakes ----------------
@@ -44,6 +46,9 @@ typedef enum {
     WORKER_LECTURA           = 2101,
     WORKER_FIN               = 2102,
     WORKER_DEVOLVER_PC       = 2103,
+    WORKER_RESUMEN_CACHE     = 2104,   // [RESUMEN_CACHE_BYTES]: File:Tags en memoria (Bloom)
+    WORKER_ARCHIVOS_QUERY    = 2105,   // [path][n][hash]*n: File:Tags que usó una corrida
+    WORKER_STATUS            = 2106,   // latido: memoria + progreso de sus Queries
 
     // ==============================================================
     //                    Worker <-> Storage
@@ -56,7 +61,13 @@ typedef enum {
     STORAGE_COMMIT           = 3007,
     STORAGE_TAG              = 3008,
     STORAGE_GET_BLOCK        = 3010,
-    STORAGE_PUT_BLOCK        = 3011
+    STORAGE_PUT_BLOCK        = 3011,
+    STORAGE_GET_BLOCKS       = 3012,   // varios bloques lógicos de un File:Tag
+    STORAGE_PUT_BLOCKS       = 3013,
+    STORAGE_OPEN             = 3014,   // File:Tag -> handle de la sesión
+    STORAGE_CLOSE            = 3015,
+    STORAGE_GET_BLOCKS_H     = 3016,   // como GET/PUT_BLOCKS pero con handle en lugar de file+tag
+    STORAGE_PUT_BLOCKS_H     = 3017
 } op_code;
 
 
@@ -70,6 +81,7 @@ typedef struct
 {
 	int size;
 	int offset;
+	int capacidad;
 	void *stream;
 } t_buffer;
 
@@ -79,13 +91,77 @@ typedef struct
 	t_buffer *buffer;
 } t_paquete;
 
+#define CONEXION_MAX_FDS 8
+
+// Estado de lectura de un socket: lo recibido y todavía no consumido queda en
+// buffer[inicio, fin), así un solo recv() puede traer varios mensajes enteros.
+typedef struct
+{
+	int fd;
+	char *buffer;
+	size_t capacidad;
+	size_t inicio;
+	size_t fin;
+	pthread_mutex_t mx_envio;
+	// transporte por memoria compartida (NULL = todo por el socket, que
+	// igual queda abierto para detectar el cierre del otro extremo)
+	t_anillo *rx;
+	t_anillo *tx;
+	// fds recibidos por SCM_RIGHTS (sólo sockets AF_UNIX)
+	int fds_recibidos[CONEXION_MAX_FDS];
+	int n_fds_recibidos;
+	// cola de salida (conexion_vigilar_salida): lo que el socket no aceptó sin
+	// bloquear queda en salida[salida_ini, salida_fin) hasta el próximo EPOLLOUT
+	char *salida;
+	size_t salida_cap;
+	size_t salida_ini;
+	size_t salida_fin;
+	int salida_epfd;   // -1 = envíos bloqueantes
+	void *salida_dato; // data.ptr del fd en ese epoll
+	bool salida_armada; // EPOLLOUT pedido
+	bool invalida;      // llegó una cabecera fuera de protocolo: hay que cerrarla
+} t_conexion;
+
+#define CONEXION_BUFFER_INICIAL 65536
+// Cuerpo más grande que se acepta: el tamaño viene del otro extremo y no se
+// reserva memoria por encima de esto. Los lotes del Worker se arman por debajo.
+#define CONEXION_PAQUETE_MAX (64 * 1024 * 1024)
+#define CONEXION_SALIDA_MAX (16 * 1024 * 1024) // tope de la cola de salida de una conexión
+
 
 int recibir_operacion(int);
 t_paquete *crear_paquete(op_code );
+t_paquete *crear_paquete_con_capacidad(op_code , int );
 void agregar_a_paquete(t_paquete *, void *, int );
 int enviar_paquete(t_paquete *, int );
+int enviar_paquete_con_datos(t_paquete *, const void *, int , int );
+int enviar_paquete_con_iov(t_paquete *paquete, const struct iovec *extra, int n_extra, int socket_destino);
+int enviar_paquete_con_archivos(t_paquete *paquete, const int *fds, int n, int len_cada, int socket_destino);
+int reenviar_paquete(t_paquete *paquete, op_code op, int desde, int socket_destino);
 void eliminar_paquete(t_paquete *);
 t_paquete* recibir_paquete(int );
 void buffer_read(void* , t_buffer* , int ) ;
+void agregar_string_a_paquete(t_paquete *paquete, const char *s);
+char *leer_string_de_paquete(t_paquete *paquete);
+
+// Resumen de caché del Worker: filtro de Bloom sobre hash_file_tag()
+#define RESUMEN_CACHE_BYTES 256   // 2048 bits
+#define HUELLA_MAX_ARCHIVOS 16    // File:Tags que se recuerdan por path de Query
+uint32_t hash_file_tag(const char *file, const char *tag);
+void resumen_agregar(uint8_t *resumen, uint32_t h);
+bool resumen_contiene(const uint8_t *resumen, uint32_t h);
 op_code obtener_codigo_instruccion(char*);
+
+t_conexion* conexion_de(int fd);
+void conexion_liberar(int fd);
+int conexion_recibir_operacion(t_conexion *);
+t_paquete* conexion_recibir_paquete(t_conexion *);
+int conexion_leer_disponible(t_conexion *);
+t_paquete* conexion_extraer_paquete(t_conexion *, int *);
+int enviar_paquete_con_fds(t_paquete *paquete, const int *fds, int n, int socket_destino);
+int conexion_tomar_fds(t_conexion *, int *out, int max);
+void conexion_adjuntar_anillos(t_conexion *, t_anillo *rx, t_anillo *tx);
+int conexion_fd_evento(t_conexion *);
+void conexion_vigilar_salida(t_conexion *, int epfd, void *dato);
+int conexion_vaciar_salida(t_conexion *);
 #endif
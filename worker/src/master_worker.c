@@ -4,13 +4,6 @@
 
 extern int g_fd_master;
 
-static char* read_cstring_from_pkg(t_paquete* p){
-    int len=0; buffer_read(&len, p->buffer, sizeof(int));
-    char* s = calloc((size_t)len,1);
-    if(len){ memcpy(s, p->buffer->stream + p->buffer->offset, (size_t)len); p->buffer->offset += len; }
-    return s;
-}
-
 void* master_listener_thread(void* _){
     (void)_;
     for(;;){
@@ -24,7 +17,8 @@ void* master_listener_thread(void* _){
         case MASTER_ASIGNAR_QUERY: {
             uint32_t qid=0, pc=0; buffer_read(&qid, pkg->buffer, sizeof(uint32_t));
             buffer_read(&pc, pkg->buffer, sizeof(uint32_t));
-            char* path = read_cstring_from_pkg(pkg);
+            char* path = leer_string_de_paquete(pkg);
+            if(!path){ log_error(g_wlogger,"MASTER_ASIGNAR_QUERY mal formado"); break; }
             log_info(g_wlogger, "## Query %u: Se recibe la Query. El path de operaciones es: %s", qid, path);
             worker_exec_start(qid, pc, path);
             free(path);
@@ -44,3 +38,56 @@ void* master_listener_thread(void* _){
     }
     return NULL;
 }
+
+// Reporta periódicamente al Master qué File:Tags tiene en memoria (sólo si
+// cambió desde el último envío); con eso el Master elige a quién asignar.
+void* resumen_cache_thread(void* _){
+    (void)_;
+    uint8_t ant[RESUMEN_CACHE_BYTES], act[RESUMEN_CACHE_BYTES];
+    bool enviado = false;
+    for(;;){
+        usleep(g_intervalo_resumen_ms*1000);
+        mem_resumen(act);
+        if(enviado && memcmp(ant, act, sizeof(act))==0) continue;
+        t_paquete* pk = crear_paquete(WORKER_RESUMEN_CACHE);
+        agregar_a_paquete(pk, act, sizeof(act));
+        if(enviar_paquete(pk, g_fd_master) < 0){ eliminar_paquete(pk); break; }
+        eliminar_paquete(pk);
+        memcpy(ant, act, sizeof(act));
+        enviado = true;
+    }
+    return NULL;
+}
+
+// Latido periódico: ocupación de memoria, fallos y progreso de cada Query.
+// Con esto el Master reparte por carga y detecta un Worker trabado.
+void* estado_thread(void* _){
+    (void)_;
+    int max = (int)g_slots_ejec;
+    t_exec_progreso* prog = malloc(sizeof(t_exec_progreso)*(size_t)max);
+    for(;;){
+        usleep(g_intervalo_estado_ms*1000);
+        t_mem_estado e; mem_estado(&e);
+        uint32_t n = (uint32_t)worker_exec_progreso(prog, max);
+        // [frames][ocupados][dirty][accesos][misses][n] + n*[qid][pc][ms][avances][espera_ms]
+        t_paquete* pk = crear_paquete(WORKER_STATUS);
+        agregar_a_paquete(pk, &e.frames, sizeof(uint32_t));
+        agregar_a_paquete(pk, &e.ocupados, sizeof(uint32_t));
+        agregar_a_paquete(pk, &e.dirty, sizeof(uint32_t));
+        agregar_a_paquete(pk, &e.accesos, sizeof(uint32_t));
+        agregar_a_paquete(pk, &e.misses, sizeof(uint32_t));
+        agregar_a_paquete(pk, &n, sizeof(uint32_t));
+        for(uint32_t i=0;i<n;i++){
+            agregar_a_paquete(pk, &prog[i].qid, sizeof(uint32_t));
+            agregar_a_paquete(pk, &prog[i].pc, sizeof(uint32_t));
+            agregar_a_paquete(pk, &prog[i].ms, sizeof(uint32_t));
+            agregar_a_paquete(pk, &prog[i].avances, sizeof(uint32_t));
+            agregar_a_paquete(pk, &prog[i].espera_ms, sizeof(uint32_t));
+        }
+        int r = enviar_paquete(pk, g_fd_master);
+        eliminar_paquete(pk);
+        if(r < 0) break;
+    }
+    free(prog);
+    return NULL;
+}
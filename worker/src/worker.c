@@ -12,6 +12,13 @@ size_t   g_mem_size_bytes = 0;
 uint32_t g_mem_delay_ms   = 0;
 t_reemplazo_algo g_reemplazo = REEMPLAZO_LRU;
 char*    g_path_scripts   = NULL;
+uint32_t g_slots_ejec     = 1;
+uint32_t g_intervalo_resumen_ms = 500;
+uint32_t g_intervalo_estado_ms  = 1000;
+uint32_t g_marca_alta_dirty = 0;
+uint32_t g_marca_baja_dirty = 0;
+uint32_t g_paginas_adelantadas = 0;
+uint32_t g_max_frames_adelantados = 0;
 
 
 static void sigint_handler(int _sig){
@@ -52,34 +59,58 @@ int main(int argc, char** argv){
     if(config_has_property(cfg,"PATH_SCRIPTS")) path = config_get_string_value(cfg,"PATH_SCRIPTS");
     else path = config_get_string_value(cfg,"PATH_QUERIES");
     g_path_scripts = strdup(path);
+    // Queries que ejecuta en paralelo (comparten la Memoria Interna)
+    if(config_has_property(cfg,"SLOTS_EJECUCION")) g_slots_ejec = (uint32_t)config_get_int_value(cfg,"SLOTS_EJECUCION");
+    if(g_slots_ejec == 0) g_slots_ejec = 1;
+    // cada cuánto se le reporta al Master qué File:Tags hay en memoria (0 = nunca)
+    if(config_has_property(cfg,"INTERVALO_RESUMEN_CACHE")) g_intervalo_resumen_ms = (uint32_t)config_get_int_value(cfg,"INTERVALO_RESUMEN_CACHE");
+    // latido con carga y progreso para el Master (0 = no se manda)
+    if(config_has_property(cfg,"INTERVALO_ESTADO")) g_intervalo_estado_ms = (uint32_t)config_get_int_value(cfg,"INTERVALO_ESTADO");
+    // write-back en segundo plano: % de frames dirty que lo dispara y hasta dónde baja (sin clave = no hay)
+    if(config_has_property(cfg,"MARCA_ALTA_DIRTY")) g_marca_alta_dirty = (uint32_t)config_get_int_value(cfg,"MARCA_ALTA_DIRTY");
+    if(config_has_property(cfg,"MARCA_BAJA_DIRTY")) g_marca_baja_dirty = (uint32_t)config_get_int_value(cfg,"MARCA_BAJA_DIRTY");
+    // lectura adelantada ante acceso secuencial: ventana en páginas y tope de frames (sin clave = no hay)
+    if(config_has_property(cfg,"PAGINAS_ADELANTADAS")) g_paginas_adelantadas = (uint32_t)config_get_int_value(cfg,"PAGINAS_ADELANTADAS");
+    if(config_has_property(cfg,"MAX_FRAMES_ADELANTADOS")) g_max_frames_adelantados = (uint32_t)config_get_int_value(cfg,"MAX_FRAMES_ADELANTADOS");
+
+    // Transporte con Storage: SOCKET (default) o SHM (anillos en memoria compartida,
+    // requiere PUERTO_STORAGE con la ruta de un socket local)
+    uint32_t tam_anillo = 0;
+    if(config_has_property(cfg,"TRANSPORTE_STORAGE") && strcmp(config_get_string_value(cfg,"TRANSPORTE_STORAGE"),"SHM")==0)
+        tam_anillo = config_has_property(cfg,"TAM_ANILLO_SHM") ? (uint32_t)config_get_int_value(cfg,"TAM_ANILLO_SHM") : (1u<<20);
 
     g_wlogger = log_create("worker.log","WORKER",1, lvl);
     signal(SIGINT, sigint_handler);
 
     if(repl && strcmp(repl,"CLOCK-M")==0) g_reemplazo = REEMPLAZO_CLOCKM; else g_reemplazo = REEMPLAZO_LRU;
 
-    log_info(g_wlogger, "Inicio Worker %u | MEM=%zuB | RETARDO=%ums | REEMPLAZO=%s | SCRIPTS=%s",
+    log_info(g_wlogger, "Inicio Worker %u | MEM=%zuB | RETARDO=%ums | REEMPLAZO=%s | SCRIPTS=%s | SLOTS=%u",
              g_worker_id, g_mem_size_bytes, g_mem_delay_ms,
-             (g_reemplazo==REEMPLAZO_CLOCKM?"CLOCK-M":"LRU"), g_path_scripts);
+             (g_reemplazo==REEMPLAZO_CLOCKM?"CLOCK-M":"LRU"), g_path_scripts, g_slots_ejec);
 
     // 1) Storage: handshake → BLOCK_SIZE
-    g_fd_storage = storage_connect_and_handshake(ip_storage, puerto_s);
+    g_fd_storage = storage_connect_and_handshake(ip_storage, puerto_s, tam_anillo);
     if(g_fd_storage < 0){ log_error(g_wlogger,"No pude conectar a Storage %s:%s", ip_storage, puerto_s); return EXIT_FAILURE; }
 
     // 2) Memoria Interna
     mem_init(g_mem_size_bytes, g_block_size, g_reemplazo, g_mem_delay_ms);
+    mem_writeback_iniciar(g_marca_alta_dirty, g_marca_baja_dirty);
+    mem_adelanto_iniciar(g_paginas_adelantadas, g_max_frames_adelantados);
 
     // 3) Conectar a Master e identificarme
     g_fd_master = crear_conexion((char*)ip_master, (char*)puerto_m);
     if(g_fd_master < 0){ log_error(g_wlogger,"No pude conectar a Master %s:%s", ip_master, puerto_m); return EXIT_FAILURE; }
     t_paquete* hello = crear_paquete(HANDSHAKE_WORKER); enviar_paquete(hello, g_fd_master); eliminar_paquete(hello);
     t_paquete* who   = crear_paquete(WORKER_IDENTIFICACION);
-    agregar_a_paquete(who, &g_worker_id, sizeof(uint32_t)); enviar_paquete(who, g_fd_master); eliminar_paquete(who);
+    agregar_a_paquete(who, &g_worker_id, sizeof(uint32_t));
+    agregar_a_paquete(who, &g_slots_ejec, sizeof(uint32_t)); enviar_paquete(who, g_fd_master); eliminar_paquete(who);
     int op = recibir_operacion(g_fd_master); if(op==MASTER_ACK){ t_paquete* ack=recibir_paquete(g_fd_master); if(ack) eliminar_paquete(ack); }
 
     // 4) Ejecutar
-    worker_exec_init();
+    worker_exec_init((int)g_slots_ejec);
     pthread_t t; pthread_create(&t, NULL, master_listener_thread, NULL); pthread_detach(t);
+    if(g_intervalo_resumen_ms > 0){ pthread_create(&t, NULL, resumen_cache_thread, NULL); pthread_detach(t); }
+    if(g_intervalo_estado_ms > 0){ pthread_create(&t, NULL, estado_thread, NULL); pthread_detach(t); }
 
     for(;;) pause();
     return 0;
@@ -29,16 +29,35 @@ extern uint32_t g_mem_delay_ms;    // RETARDO_MEMORIA
 typedef enum { REEMPLAZO_LRU, REEMPLAZO_CLOCKM } t_reemplazo_algo;
 extern t_reemplazo_algo g_reemplazo;   // LRU / CLOCK-M
 extern char*    g_path_scripts;        // PATH_SCRIPTS (malloc)
+extern uint32_t g_slots_ejec;          // SLOTS_EJECUCION: Queries en paralelo
+extern uint32_t g_intervalo_resumen_ms; // INTERVALO_RESUMEN_CACHE: 0 = no se reporta
+extern uint32_t g_intervalo_estado_ms;  // INTERVALO_ESTADO: latido WORKER_STATUS, 0 = no se manda
+extern uint32_t g_marca_alta_dirty;     // MARCA_ALTA_DIRTY: % de frames dirty que despierta al flusher
+extern uint32_t g_marca_baja_dirty;     // MARCA_BAJA_DIRTY: % al que baja
+extern uint32_t g_paginas_adelantadas;  // PAGINAS_ADELANTADAS: ventana de lectura adelantada, 0 = no hay
+extern uint32_t g_max_frames_adelantados; // MAX_FRAMES_ADELANTADOS: tope de frames para esa ventana
 
 // ====== Master listener / Exec ======
 void* master_listener_thread(void* _);
-void  worker_exec_init(void);
+void* resumen_cache_thread(void* _);
+void* estado_thread(void* _);
+void  worker_exec_init(int slots);
 void  worker_exec_shutdown(void);
 void  worker_exec_start(uint32_t qid, uint32_t pc_inicial, const char* path_query);
 void  worker_exec_request_preempt(uint32_t qid);
+// progreso de las Queries en ejecución (WORKER_STATUS)
+typedef struct {
+    uint32_t qid, pc;
+    uint32_t ms;        // desde que se asignó
+    uint32_t avances;   // accesos a memoria y respuestas de Storage desde el reporte anterior
+    uint32_t espera_ms; // cuánto lleva esperando una respuesta de Storage (0 = no espera)
+} t_exec_progreso;
+int   worker_exec_progreso(t_exec_progreso* out, int max); // devuelve cuántas (a lo sumo max)
+void  worker_exec_avance(void);
+void  worker_exec_esperando_storage(bool esperando);
 
 // ====== Storage API ======
-int    storage_connect_and_handshake(const char* ip, const char* puerto);
+int    storage_connect_and_handshake(const char* ip, const char* puerto, uint32_t tam_anillo); // tam_anillo 0 = sólo socket
 int    storage_create(const char* file, const char* tag);
 int    storage_truncate(const char* file, const char* tag, uint32_t new_size);
 int    storage_delete(const char* file, const char* tag);
@@ -47,15 +66,35 @@ int    storage_tag(const char* f_src, const char* t_src, const char* f_dst, cons
 // bloques
 char*  storage_get_block(const char* file, const char* tag, uint32_t page); // malloc de size=BLOCK_SIZE
 int    storage_put_block(const char* file, const char* tag, uint32_t page, const char* data, uint32_t len);
+// pedidos sin esperar la respuesta: cada _async se cierra con su _esperar
+typedef struct t_st_pedido t_st_pedido;
+t_st_pedido* storage_get_block_async(const char* file, const char* tag, uint32_t page);
+char*        storage_get_block_esperar(t_st_pedido* pd);               // malloc BLOCK_SIZE o NULL
+t_st_pedido* storage_put_block_async(const char* file, const char* tag, uint32_t page, const char* data, uint32_t len);
+int          storage_put_block_esperar(t_st_pedido* pd);
+// lotes de bloques de un mismo File:Tag
+t_st_pedido* storage_get_blocks_async(const char* file, const char* tag, uint32_t n, const uint32_t* pages);
+int          storage_get_blocks_esperar(t_st_pedido* pd, uint32_t n, char* out); // out: n*BLOCK_SIZE; devuelve status
+t_st_pedido* storage_put_blocks_async(const char* file, const char* tag, uint32_t n, const uint32_t* pages, const char* const* datas, uint32_t len);
+int          storage_put_blocks_esperar(t_st_pedido* pd);
 
 // ====== Memoria Interna ======
 void   mem_init(size_t mem_bytes, uint32_t page_size, t_reemplazo_algo algo, uint32_t delay_ms);
 void   mem_destroy(void);
+// NULL / -1 si faltó memoria porque Storage no aceptó las víctimas dirty
 char*  mem_read(uint32_t qid, const char* file, const char* tag, size_t base, size_t size); // malloc con size bytes
 int    mem_write(uint32_t qid, const char* file, const char* tag, size_t base, const char* data, size_t len);
-void   mem_flush_file(uint32_t qid, const char* file, const char* tag);
+int    mem_flush_file(uint32_t qid, const char* file, const char* tag); // 0 o -1 si Storage rechazó
 void   mem_invalidate_from_page(uint32_t qid, const char* file, const char* tag, uint32_t first_page);
 void   mem_flush_set(uint32_t qid, t_list* touched_filetags);  // elementos "file:tag"
 void   mem_drop_file(const char* file, const char* tag);       // liberar frames de ese file:tag
+void   mem_resumen(uint8_t* out);                               // RESUMEN_CACHE_BYTES
+typedef struct {
+    uint32_t frames, ocupados, dirty;
+    uint32_t accesos, misses;   // desde la llamada anterior
+} t_mem_estado;
+void   mem_estado(t_mem_estado* e);
+void   mem_writeback_iniciar(uint32_t alta_pct, uint32_t baja_pct); // 0 = sin flusher
+void   mem_adelanto_iniciar(uint32_t ventana, uint32_t max_frames);  // 0 = sin lectura adelantada
 
 #endif
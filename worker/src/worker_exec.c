@@ -1,15 +1,21 @@
 // worker_exec.c
 
+#include <time.h>
 #include "worker.h"
 
-static inline void add_cstring(t_paquete* p, const char* s){ int len=s?(int)strlen(s)+1:1; agregar_a_paquete(p,&len,sizeof(int)); agregar_a_paquete(p,(void*)s,len); }
 static void send_worker_lectura(uint32_t qid, const char* filetag, const char* contenido){
     t_paquete* pk = crear_paquete(WORKER_LECTURA); agregar_a_paquete(pk,&qid,sizeof(uint32_t));
-    add_cstring(pk,filetag); add_cstring(pk,contenido); enviar_paquete(pk,g_fd_master); eliminar_paquete(pk);
+    agregar_string_a_paquete(pk,filetag); agregar_string_a_paquete(pk,contenido); enviar_paquete(pk,g_fd_master); eliminar_paquete(pk);
 }
 static void send_worker_fin(uint32_t qid, const char* motivo){
     t_paquete* pk = crear_paquete(WORKER_FIN); agregar_a_paquete(pk,&qid,sizeof(uint32_t));
-    add_cstring(pk,motivo); enviar_paquete(pk,g_fd_master); eliminar_paquete(pk);
+    agregar_string_a_paquete(pk,motivo); enviar_paquete(pk,g_fd_master); eliminar_paquete(pk);
+}
+static void send_worker_archivos(const char* path, const uint32_t* hashes, int n){
+    t_paquete* pk = crear_paquete(WORKER_ARCHIVOS_QUERY); agregar_string_a_paquete(pk,path);
+    uint32_t nn=(uint32_t)n; agregar_a_paquete(pk,&nn,sizeof(uint32_t));
+    if(n>0) agregar_a_paquete(pk,(void*)hashes,n*(int)sizeof(uint32_t));
+    enviar_paquete(pk,g_fd_master); eliminar_paquete(pk);
 }
 static void send_worker_devolver_pc(uint32_t qid, uint32_t pc){
     t_paquete* pk = crear_paquete(WORKER_DEVOLVER_PC); agregar_a_paquete(pk,&qid,sizeof(uint32_t));
@@ -17,6 +23,7 @@ static void send_worker_devolver_pc(uint32_t qid, uint32_t pc){
 }
 
 // -------- Estado de ejecución --------
+// Un slot por Query en ejecución (SLOTS_EJECUCION); todos bajo g_mx.
 typedef struct {
     uint32_t qid;
     uint32_t pc;
@@ -24,24 +31,41 @@ typedef struct {
     pthread_t thread;
     bool     running;
     bool     preempt;
-    pthread_mutex_t mx;
     t_list*  touched;    // lista de char* "file:tag" modificados (para flush por desalojo)
+    uint32_t archivos[HUELLA_MAX_ARCHIVOS]; // hash de los File:Tags leídos/escritos (afinidad en el Master)
+    int      n_archivos;
+    uint64_t inicio_ms;  // cuándo se asignó (progreso en WORKER_STATUS)
+    uint32_t avances;    // accesos a memoria y respuestas de Storage propios (atómico, se reinicia al reportar)
+    uint64_t espera_desde_ms; // esperando una respuesta de Storage desde (0 = no espera)
 } t_exec;
 
-static t_exec g_exec = {0};
+static t_exec*         g_slots = NULL;
+static int             g_n_slots = 0;
+static pthread_mutex_t g_mx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  c_libre = PTHREAD_COND_INITIALIZER;  // algún slot pasó a libre
+static __thread t_exec* tl_ex = NULL; // slot del hilo de ejecución (NULL en los demás hilos)
 
 // helpers
+static uint64_t ahora_ms(void){
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000 + (uint64_t)ts.tv_nsec/1000000;
+}
 static char* join_path(const char* dir, const char* name){
     if(!name) return strdup("");
     if(name[0]=='/' || strchr(name,'/')) return strdup(name);
     size_t n = strlen(dir)+1+strlen(name)+1; char* r=malloc(n); snprintf(r,n,"%s/%s",dir,name); return r;
 }
-static void touched_add(const char* file, const char* tag){
+static void touched_add(t_exec* ex, const char* file, const char* tag){
     char* ft = string_from_format("%s:%s", file, tag);
-    for(int i=0;i<list_size(g_exec.touched);++i){
-        if(strcmp(list_get(g_exec.touched,i),ft)==0){ free(ft); return; }
+    for(int i=0;i<list_size(ex->touched);++i){
+        if(strcmp(list_get(ex->touched,i),ft)==0){ free(ft); return; }
     }
-    list_add(g_exec.touched, ft);
+    list_add(ex->touched, ft);
+}
+static void archivo_usado(t_exec* ex, const char* file, const char* tag){
+    uint32_t h = hash_file_tag(file, tag);
+    for(int i=0;i<ex->n_archivos;++i) if(ex->archivos[i]==h) return;
+    if(ex->n_archivos < HUELLA_MAX_ARCHIVOS) ex->archivos[ex->n_archivos++] = h;
 }
 
 // parsing file:tag y números
@@ -86,11 +110,12 @@ static instr_t parse_line(char* line, char*** argv, int* argc){
 static void free_args(char** argv, int argc){ for(int i=0;i<argc;i++) free(argv[i]); free(argv); }
 
 // ---- Hilo de ejecución ----
-static void* run(void* _){
-    (void)_;
-    pthread_mutex_lock(&g_exec.mx);
-    uint32_t qid=g_exec.qid, pc=g_exec.pc; char* path=join_path(g_path_scripts, g_exec.path);
-    pthread_mutex_unlock(&g_exec.mx);
+static void* run(void* arg){
+    t_exec* ex = arg;
+    tl_ex = ex;
+    pthread_mutex_lock(&g_mx);
+    uint32_t qid=ex->qid, pc=ex->pc; char* path=join_path(g_path_scripts, ex->path);
+    pthread_mutex_unlock(&g_mx);
 
     // abrir script
     FILE* f = fopen(path,"r");
@@ -107,10 +132,10 @@ static void* run(void* _){
         log_info(g_wlogger, "## Query %u: FETCH - Program Counter: %u - %s", qid, pc, line);
 
         // check desalojo
-        pthread_mutex_lock(&g_exec.mx); bool pre=g_exec.preempt; pthread_mutex_unlock(&g_exec.mx);
+        pthread_mutex_lock(&g_mx); bool pre=ex->preempt; pthread_mutex_unlock(&g_mx);
         if(pre){
             // flush implícito de los modificados
-            mem_flush_set(qid, g_exec.touched);
+            mem_flush_set(qid, ex->touched);
             send_worker_devolver_pc(qid, pc);
             break;
         }
@@ -149,8 +174,9 @@ static void* run(void* _){
             char *file=NULL,*tag=NULL; if(!split_filetag(argv[1],&file,&tag)){ send_worker_fin(qid,"ERROR_FILETAG"); free_args(argv,argc); goto fin; }
             size_t base=(size_t)strtoull(argv[2],NULL,10);
             const char* contenido = argv[3];
-            mem_write(qid, file, tag, base, contenido, strlen(contenido));
-            touched_add(file,tag);
+            if(mem_write(qid, file, tag, base, contenido, strlen(contenido)) != 0){ send_worker_fin(qid,"ERROR_STORAGE_FLUSH"); free(file); free(tag); free_args(argv,argc); goto fin; }
+            touched_add(ex,file,tag);
+            archivo_usado(ex,file,tag);
             log_info(g_wlogger, "## Query %u: - Instrucción realizada: WRITE %s:%s %zu \"%s\"", qid,file,tag,base,contenido);
             free(file); free(tag); pc++;
         } break;
@@ -161,6 +187,8 @@ static void* run(void* _){
             size_t base=(size_t)strtoull(argv[2],NULL,10);
             size_t size=(size_t)strtoull(argv[3],NULL,10);
             char* out = mem_read(qid, file, tag, base, size);
+            if(!out){ send_worker_fin(qid,"ERROR_STORAGE_FLUSH"); free(file); free(tag); free_args(argv,argc); goto fin; }
+            archivo_usado(ex,file,tag);
             char* ft = string_from_format("%s:%s", file, tag);
             send_worker_lectura(qid, ft, out);
             log_info(g_wlogger, "## Query %u: - Instrucción realizada: READ %s:%s %zu %zu", qid,file,tag,base,size);
@@ -183,7 +211,7 @@ static void* run(void* _){
             if(argc<2){ send_worker_fin(qid,"ERROR_ARGS_COMMIT"); free_args(argv,argc); goto fin; }
             char *file=NULL,*tag=NULL; if(!split_filetag(argv[1],&file,&tag)){ send_worker_fin(qid,"ERROR_FILETAG"); free_args(argv,argc); goto fin; }
             // FLUSH implícito
-            mem_flush_file(qid,file,tag);
+            if(mem_flush_file(qid,file,tag)!=0){ send_worker_fin(qid,"ERROR_STORAGE_FLUSH"); free(file); free(tag); free_args(argv,argc); goto fin; }
             if(storage_commit(file,tag)!=0){ send_worker_fin(qid,"ERROR_STORAGE_COMMIT"); free(file); free(tag); free_args(argv,argc); goto fin; }
             log_info(g_wlogger, "## Query %u: - Instrucción realizada: COMMIT %s:%s", qid,file,tag);
             free(file); free(tag); pc++;
@@ -192,7 +220,7 @@ static void* run(void* _){
         case I_FLUSH: {
             if(argc<2){ send_worker_fin(qid,"ERROR_ARGS_FLUSH"); free_args(argv,argc); goto fin; }
             char *file=NULL,*tag=NULL; if(!split_filetag(argv[1],&file,&tag)){ send_worker_fin(qid,"ERROR_FILETAG"); free_args(argv,argc); goto fin; }
-            mem_flush_file(qid,file,tag);
+            if(mem_flush_file(qid,file,tag)!=0){ send_worker_fin(qid,"ERROR_STORAGE_FLUSH"); free(file); free(tag); free_args(argv,argc); goto fin; }
             log_info(g_wlogger, "## Query %u: - Instrucción realizada: FLUSH %s:%s", qid,file,tag);
             free(file); free(tag); pc++;
         } break;
@@ -215,43 +243,89 @@ static void* run(void* _){
         }
         free_args(argv,argc);
         // actualizar PC compartido
-        pthread_mutex_lock(&g_exec.mx); g_exec.pc = pc; pthread_mutex_unlock(&g_exec.mx);
+        pthread_mutex_lock(&g_mx); ex->pc = pc; pthread_mutex_unlock(&g_mx);
     }
 
 fin:
+    // con qué File:Tags trabajó esta corrida: el Master manda las próximas
+    // del mismo path a un Worker que ya los tenga en memoria
+    if(ex->n_archivos > 0) send_worker_archivos(ex->path, ex->archivos, ex->n_archivos);
     free(line); fclose(f); free(path);
 end:
-    pthread_mutex_lock(&g_exec.mx);
-    g_exec.running=false;
+    pthread_mutex_lock(&g_mx);
+    ex->running=false;
     // liberar lista touched
-    for(int i=0;i<list_size(g_exec.touched);++i) free(list_get(g_exec.touched,i));
-    list_clean(g_exec.touched);
-    pthread_mutex_unlock(&g_exec.mx);
+    for(int i=0;i<list_size(ex->touched);++i) free(list_get(ex->touched,i));
+    list_clean(ex->touched);
+    pthread_cond_broadcast(&c_libre);
+    pthread_mutex_unlock(&g_mx);
     return NULL;
 }
 
 // API
-void worker_exec_init(void){
-    memset(&g_exec,0,sizeof(g_exec));
-    pthread_mutex_init(&g_exec.mx,NULL);
-    g_exec.touched = list_create();
+void worker_exec_init(int slots){
+    g_n_slots = slots > 0 ? slots : 1;
+    g_slots = calloc((size_t)g_n_slots, sizeof(t_exec));
+    for(int i=0;i<g_n_slots;i++) g_slots[i].touched = list_create();
 }
 void worker_exec_shutdown(void){
-    for(int i=0;i<list_size(g_exec.touched);++i) free(list_get(g_exec.touched,i));
-    list_destroy(g_exec.touched);
-    pthread_mutex_destroy(&g_exec.mx);
+    for(int i=0;i<g_n_slots;i++){
+        t_exec* ex = &g_slots[i];
+        for(int j=0;j<list_size(ex->touched);++j) free(list_get(ex->touched,j));
+        list_destroy(ex->touched);
+        free(ex->path);
+    }
+    free(g_slots); g_slots = NULL; g_n_slots = 0;
 }
 void worker_exec_start(uint32_t qid, uint32_t pc_inicial, const char* path_query){
-    pthread_mutex_lock(&g_exec.mx);
-    if(g_exec.running){ log_error(g_wlogger,"Asignación recibida con Worker ocupado."); pthread_mutex_unlock(&g_exec.mx); return; }
-    g_exec.qid=qid; g_exec.pc=pc_inicial;
-    free(g_exec.path); g_exec.path=strdup(path_query);
-    g_exec.preempt=false; g_exec.running=true;
-    pthread_create(&g_exec.thread,NULL,run,NULL); pthread_detach(g_exec.thread);
-    pthread_mutex_unlock(&g_exec.mx);
+    pthread_mutex_lock(&g_mx);
+    // FIN / DEVOLVER_PC salen antes de que el hilo termine de limpiar: el Master
+    // puede asignar la siguiente enseguida, así que se espera a que haya un slot
+    t_exec* ex = NULL;
+    for(;;){
+        for(int i=0;i<g_n_slots && !ex;i++) if(!g_slots[i].running) ex = &g_slots[i];
+        if(ex) break;
+        log_debug(g_wlogger,"Asignación de la Query %u con todos los slots ocupados: se espera uno", qid);
+        pthread_cond_wait(&c_libre, &g_mx);
+    }
+    ex->qid=qid; ex->pc=pc_inicial;
+    free(ex->path); ex->path=strdup(path_query);
+    ex->preempt=false; ex->running=true; ex->n_archivos=0; ex->inicio_ms=ahora_ms();
+    ex->avances=0; ex->espera_desde_ms=0;
+    pthread_create(&ex->thread,NULL,run,ex); pthread_detach(ex->thread);
+    pthread_mutex_unlock(&g_mx);
 }
 void worker_exec_request_preempt(uint32_t qid){
-    pthread_mutex_lock(&g_exec.mx);
-    if(g_exec.running && g_exec.qid==qid) g_exec.preempt=true;
-    pthread_mutex_unlock(&g_exec.mx);
+    pthread_mutex_lock(&g_mx);
+    for(int i=0;i<g_n_slots;i++)
+        if(g_slots[i].running && g_slots[i].qid==qid) g_slots[i].preempt=true;
+    pthread_mutex_unlock(&g_mx);
+}
+// Progreso propio de la Query del hilo que llama: lo cuentan la memoria y
+// Storage cuando trabajan para una Query (el flusher y la lectura adelantada
+// corren en otros hilos y no cuentan).
+void worker_exec_avance(void){
+    if(tl_ex) __sync_fetch_and_add(&tl_ex->avances, 1);
+}
+void worker_exec_esperando_storage(bool esperando){
+    if(!tl_ex) return;
+    pthread_mutex_lock(&g_mx);
+    tl_ex->espera_desde_ms = esperando ? ahora_ms() : 0;
+    pthread_mutex_unlock(&g_mx);
+}
+
+int worker_exec_progreso(t_exec_progreso* out, int max){
+    uint64_t ahora = ahora_ms();
+    int n = 0;
+    pthread_mutex_lock(&g_mx);
+    for(int i=0;i<g_n_slots && n<max;i++){
+        t_exec* ex = &g_slots[i];
+        if(!ex->running) continue;
+        out[n].qid = ex->qid; out[n].pc = ex->pc; out[n].ms = (uint32_t)(ahora - ex->inicio_ms);
+        out[n].avances = __sync_lock_test_and_set(&ex->avances, 0);
+        out[n].espera_ms = ex->espera_desde_ms ? (uint32_t)(ahora - ex->espera_desde_ms) : 0;
+        n++;
+    }
+    pthread_mutex_unlock(&g_mx);
+    return n;
 }
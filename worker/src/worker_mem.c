@@ -2,22 +2,60 @@
 
 #include "worker.h"
 
-typedef struct {
-    char* file; char* tag; uint32_t page;
+typedef struct t_page {
+    uint32_t ft;   // file:tag internado (g_ft)
+    uint32_t page;
     bool  dirty;
     bool  ref;     // usado por CLOCK-M
     int   frame;   // índice de frame
+    int   pins;    // accesos en curso (no se puede desalojar ni soltar)
+    int   escritores; // de esos pines, los que escriben (no se baja a mitad de una escritura)
+    bool  cargando;// en tránsito con Storage: entrando o saliendo como víctima
+    bool  bajando; // copiándose a Storage en un flush: no se escribe hasta que termine
+    bool  adelantada; // traída por lectura adelantada y todavía sin usar
+    struct t_page* lru_ant; // lista LRU intrusiva (sólo con REEMPLAZO_LRU)
+    struct t_page* lru_sig;
+    struct t_page* res_ant; // páginas residentes de su file:tag
+    struct t_page* res_sig;
+    struct t_page* suc_ant; // páginas dirty de su file:tag
+    struct t_page* suc_sig;
 } t_page;
 
+// Con varios slots de ejecución la memoria es compartida: las estructuras se
+// tocan bajo m_mem, pero el retardo y la E/S con Storage van fuera del lock.
+// Una página se pinea mientras se copia; una en tránsito queda en la tabla
+// con `cargando` y quien la busque espera en c_mem.
+static pthread_mutex_t m_mem = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  c_mem = PTHREAD_COND_INITIALIZER;
+
 static char* g_mem = NULL;
 static uint32_t g_page_size = 0;
+static uint32_t g_lote_max = 1;  // páginas por pedido por lote (entran en CONEXION_PAQUETE_MAX)
 static int g_frames = 0;
 static t_reemplazo_algo g_algo;
 static uint32_t g_delay_ms;
-static t_dictionary* g_ptable = NULL;   // key "file:tag#page" -> t_page*
-static t_list* g_lru = NULL;            // lista de t_page* en orden LRU (cola = más reciente)
+static t_page* g_lru = NULL;            // LRU: cabeza = menos reciente
+static t_page* g_lru_fin = NULL;        //      cola = más reciente
 static int g_clk_hand = 0;              // índice circular para CLOCK-M (sobre vector frames)
 static t_page** g_by_frame = NULL;      // frame->page*
+static int* g_libres = NULL;            // pila de frames libres
+static int  g_libres_n = 0;
+static uint32_t g_accesos = 0, g_misses = 0; // para WORKER_STATUS (se reinician al reportar)
+static uint32_t g_sucias = 0;           // páginas dirty en total
+
+// Write-back en segundo plano: al pasar g_marca_alta páginas dirty el flusher
+// baja a Storage hasta quedar en g_marca_baja (0 = deshabilitado)
+static pthread_cond_t c_flusher = PTHREAD_COND_INITIALIZER;
+static uint32_t g_marca_alta = 0, g_marca_baja = 0;
+#define FLUSHER_REINTENTO_MS 200
+
+// Lectura adelantada: ante lecturas secuenciales de un file:tag un hilo trae
+// las g_ra_ventana páginas siguientes en un pedido por lote mientras la Query
+// sigue; a lo sumo g_ra_max frames con páginas adelantadas todavía sin usar
+typedef struct { uint32_t qid, ft, desde, hasta; } t_adelanto;
+static pthread_cond_t c_adelanto = PTHREAD_COND_INITIALIZER;
+static t_list*  g_adelantos = NULL;     // t_adelanto* pendientes
+static uint32_t g_ra_ventana = 0, g_ra_max = 0, g_ra_n = 0;
 
 static inline void mem_delay(void){
     usleep(g_delay_ms*1000); 
@@ -25,9 +63,6 @@ static inline void mem_delay(void){
 
 static inline int  frame_offset(int frame){ return frame * (int)g_page_size; }
 
-static char* key_ftp(const char* f, const char* t, uint32_t p){
-    char* ft = string_from_format("%s:%s#%u", f,t,p); return ft;
-}
 static void log_assign(uint32_t qid, int frame, const char* f, const char* t, uint32_t p){
     log_info(g_wlogger, "Query %u: Se asigna el Marco: %d a la Página: %u perteneciente al - File: %s - Tag: %s",
              qid, frame, p, f, t);
@@ -47,129 +82,588 @@ static void log_reemplazo(uint32_t qid, const char* f1,const char* t1,uint32_t p
     log_info(g_wlogger, "## Query %u: Se reemplaza la página %s:%s/%u por la %s:%s/%u",
              qid, f1,t1,p1, f2,t2,p2);
 }
-static void log_mem_rw(uint32_t qid, const char* accion, size_t phy, const char* val){
-    log_info(g_wlogger, "Query %u: Acción: %s - Dirección Física: %zu - Valor: %s",
-             qid, accion, phy, val?val:"");
+// val no necesita '\0': se muestran hasta 32 bytes (o hasta un '\0')
+static void log_mem_rw(uint32_t qid, const char* accion, size_t phy, const char* val, size_t len){
+    log_info(g_wlogger, "Query %u: Acción: %s - Dirección Física: %zu - Valor: %.*s",
+             qid, accion, phy, (int)(len>32?32:len), val);
+}
+
+// ====== File:Tags internados ======
+// Cada file:tag distinto recibe un id chico y estable (no se reciclan: son
+// pocos y viven lo que el Worker). Páginas y tabla de páginas guardan el id,
+// así un acceso no arma ni compara strings. Índice por direccionamiento
+// abierto sobre hash_file_tag (el mismo hash que va en el resumen de caché).
+// Cada uno lleva además sus páginas en memoria y, aparte, las dirty: flush,
+// drop e invalidate recorren sólo eso, no todos los frames.
+typedef struct {
+    char* file; char* tag; uint32_t hash;
+    t_page*  residentes;
+    t_page*  sucias;
+    uint32_t n_sucias;
+    uint32_t n_bajando; // páginas viajando a Storage (flush o víctima)
+    uint32_t ra_sig;    // página siguiente a la última leída (0 = sin lecturas)
+    uint32_t ra_hasta;  // lectura adelantada ya pedida hasta acá (excluida)
+} t_filetag;
+static t_filetag* g_ft = NULL;          // id -> file:tag
+static uint32_t   g_ft_n = 0, g_ft_cap = 0;
+static uint32_t*  g_ft_idx = NULL;      // id+1 (0 = libre)
+static uint32_t   g_ft_idx_cap = 0;     // potencia de 2
+
+static uint32_t* ft_buscar(const char* f, const char* t, uint32_t h){
+    uint32_t mask = g_ft_idx_cap - 1;
+    for(uint32_t i = h & mask;; i = (i + 1) & mask){
+        uint32_t id1 = g_ft_idx[i];
+        if(!id1) return &g_ft_idx[i];
+        t_filetag* e = &g_ft[id1-1];
+        if(e->hash == h && strcmp(e->file,f)==0 && strcmp(e->tag,t)==0) return &g_ft_idx[i];
+    }
+}
+
+static void ft_crecer(void){
+    uint32_t cap = g_ft_idx_cap ? g_ft_idx_cap * 2 : 64;
+    free(g_ft_idx);
+    g_ft_idx = calloc(cap, sizeof(uint32_t));
+    g_ft_idx_cap = cap;
+    for(uint32_t id=0; id<g_ft_n; ++id){
+        uint32_t i = g_ft[id].hash & (cap - 1);
+        while(g_ft_idx[i]) i = (i + 1) & (cap - 1);
+        g_ft_idx[i] = id + 1;
+    }
+}
+
+// Con m_mem tomado. -1 si no está y no hay que crearlo
+static int ft_id(const char* f, const char* t, bool crear){
+    if(!g_ft_idx_cap) ft_crecer();
+    uint32_t h = hash_file_tag(f,t);
+    uint32_t* s = ft_buscar(f,t,h);
+    if(*s) return (int)(*s - 1);
+    if(!crear) return -1;
+    if((g_ft_n + 1) * 10 > g_ft_idx_cap * 7){ ft_crecer(); s = ft_buscar(f,t,h); }
+    if(g_ft_n == g_ft_cap){
+        g_ft_cap = g_ft_cap ? g_ft_cap * 2 : 32;
+        g_ft = realloc(g_ft, (size_t)g_ft_cap * sizeof(t_filetag));
+    }
+    g_ft[g_ft_n] = (t_filetag){ .file = strdup(f), .tag = strdup(t), .hash = h };
+    *s = ++g_ft_n;
+    return (int)g_ft_n - 1;
+}
+
+static int ft_id_lock(const char* f, const char* t, bool crear){
+    pthread_mutex_lock(&m_mem);
+    int id = ft_id(f, t, crear);
+    pthread_mutex_unlock(&m_mem);
+    return id;
+}
+
+// ====== Tabla de páginas ======
+// (file:tag id, página) -> t_page*, sondeo lineal sin lápidas (el borrado
+// corre hacia atrás los elementos del cluster). Tiene una entrada por frame
+// más las víctimas en tránsito: arranca al doble de frames y casi no crece.
+typedef struct { uint32_t ft, page; t_page* pg; } t_pslot;
+static t_pslot* g_pt = NULL;
+static uint32_t g_pt_cap = 0, g_pt_n = 0;   // cap potencia de 2
+
+static uint32_t pt_hash(uint32_t ft, uint32_t page, uint32_t mask){
+    uint32_t h = ft * 2654435761u ^ (page + 0x9E3779B9u) * 2246822519u;
+    return (h ^ (h >> 15)) & mask;
+}
+
+static t_pslot* pt_buscar(uint32_t ft, uint32_t page){
+    uint32_t mask = g_pt_cap - 1;
+    for(uint32_t i = pt_hash(ft, page, mask);; i = (i + 1) & mask){
+        t_pslot* s = &g_pt[i];
+        if(!s->pg || (s->ft == ft && s->page == page)) return s;
+    }
+}
+
+// Listas por file:tag (intrusivas, con m_mem tomado)
+static void residente_poner(t_page* pg){
+    t_filetag* e = &g_ft[pg->ft];
+    pg->res_ant = NULL;
+    pg->res_sig = e->residentes;
+    if(e->residentes) e->residentes->res_ant = pg;
+    e->residentes = pg;
+}
+
+static void residente_quitar(t_page* pg){
+    if(pg->res_ant) pg->res_ant->res_sig = pg->res_sig;
+    else g_ft[pg->ft].residentes = pg->res_sig;
+    if(pg->res_sig) pg->res_sig->res_ant = pg->res_ant;
+    pg->res_ant = pg->res_sig = NULL;
+}
+
+static void sucia_marcar(t_page* pg){
+    if(pg->dirty) return;
+    t_filetag* e = &g_ft[pg->ft];
+    pg->dirty = true;
+    pg->suc_ant = NULL;
+    pg->suc_sig = e->sucias;
+    if(e->sucias) e->sucias->suc_ant = pg;
+    e->sucias = pg;
+    e->n_sucias++; g_sucias++;
+    if(g_marca_alta && g_sucias == g_marca_alta) pthread_cond_signal(&c_flusher);
+}
+
+static void sucia_limpiar(t_page* pg){
+    if(!pg->dirty) return;
+    t_filetag* e = &g_ft[pg->ft];
+    if(pg->suc_ant) pg->suc_ant->suc_sig = pg->suc_sig;
+    else e->sucias = pg->suc_sig;
+    if(pg->suc_sig) pg->suc_sig->suc_ant = pg->suc_ant;
+    pg->suc_ant = pg->suc_sig = NULL;
+    pg->dirty = false;
+    e->n_sucias--; g_sucias--;
+}
+
+static t_page* pt_get(uint32_t ft, uint32_t page){
+    return pt_buscar(ft, page)->pg;
+}
+
+static void pt_put(t_page* pg){
+    if((g_pt_n + 1) * 10 > g_pt_cap * 7){
+        t_pslot* viejos = g_pt;
+        uint32_t cap = g_pt_cap;
+        g_pt = calloc((size_t)cap * 2, sizeof(t_pslot));
+        g_pt_cap = cap * 2;
+        for(uint32_t i=0;i<cap;++i)
+            if(viejos[i].pg) *pt_buscar(viejos[i].ft, viejos[i].page) = viejos[i];
+        free(viejos);
+    }
+    t_pslot* s = pt_buscar(pg->ft, pg->page);
+    if(!s->pg) g_pt_n++;
+    *s = (t_pslot){ pg->ft, pg->page, pg };
+    residente_poner(pg);
+}
+
+static void pt_quitar(t_page* pg){
+    uint32_t mask = g_pt_cap - 1;
+    t_pslot* s = pt_buscar(pg->ft, pg->page);
+    if(s->pg != pg) return;
+    g_pt_n--;
+    residente_quitar(pg);
+    sucia_limpiar(pg);
+    if(pg->adelantada){ pg->adelantada = false; g_ra_n--; }
+    uint32_t hueco = (uint32_t)(s - g_pt);
+    for(uint32_t i = (hueco + 1) & mask; g_pt[i].pg; i = (i + 1) & mask){
+        uint32_t ideal = pt_hash(g_pt[i].ft, g_pt[i].page, mask);
+        if(((i - ideal) & mask) >= ((i - hueco) & mask)){
+            g_pt[hueco] = g_pt[i];
+            hueco = i;
+        }
+    }
+    g_pt[hueco].pg = NULL;
 }
 
 void mem_init(size_t mem_bytes, uint32_t page_size, t_reemplazo_algo algo, uint32_t delay_ms){
     g_mem = calloc(mem_bytes,1);
     g_page_size = page_size;
     g_frames = (int)(mem_bytes / page_size);
+    // cuerpo de un lote: [handle o file/tag][n][n páginas][len][n*page_size]; se deja 1 MiB para todo menos los datos
+    g_lote_max = (uint32_t)((CONEXION_PAQUETE_MAX - (1 << 20)) / ((size_t)page_size + 2*sizeof(uint32_t)));
+    if(g_lote_max == 0) g_lote_max = 1;
     g_algo = algo;
     g_delay_ms = delay_ms;
 
-    g_ptable = dictionary_create();
-    g_lru    = list_create();
+    g_pt_cap = 16;
+    while(g_pt_cap < 2u * (uint32_t)g_frames) g_pt_cap <<= 1;
+    g_pt     = calloc(g_pt_cap, sizeof(t_pslot));
+    g_pt_n   = 0;
+    g_lru = g_lru_fin = NULL;
     g_by_frame = calloc(g_frames, sizeof(t_page*));
+    // al revés, así el primero en salir es el frame 0
+    g_libres = malloc((size_t)g_frames * sizeof(int));
+    g_libres_n = 0;
+    for(int i=g_frames-1;i>=0;i--) g_libres[g_libres_n++] = i;
     g_clk_hand = 0;
 }
 void mem_destroy(void){
     if(!g_mem) return;
-    for(int i=0;i<g_frames;i++) if(g_by_frame[i]){
-        free(g_by_frame[i]->file); free(g_by_frame[i]->tag); free(g_by_frame[i]);
-    }
-    list_destroy(g_lru);
-    dictionary_destroy(g_ptable);
+    for(int i=0;i<g_frames;i++) free(g_by_frame[i]);
+    free(g_libres);
+    free(g_pt);
+    for(uint32_t i=0;i<g_ft_n;i++){ free(g_ft[i].file); free(g_ft[i].tag); }
+    free(g_ft); free(g_ft_idx);
+    if(g_adelantos) list_destroy_and_destroy_elements(g_adelantos, free);
     free(g_by_frame);
     free(g_mem);
     g_mem=NULL;
 }
 
-// buscar o cargar página; retorna t_page* y aplica logs/miss/add/asignación
-static t_page* ensure_page(uint32_t qid, const char* f, const char* t, uint32_t p){
-    char* k = key_ftp(f,t,p);
-    t_page* pg = dictionary_get(g_ptable, k);
-    if(pg){
-        // LRU: mover a cola
-        if(g_algo==REEMPLAZO_LRU){
-            for(int i=0;i<list_size(g_lru);++i) if(list_get(g_lru,i)==pg){ list_remove(g_lru,i); break; }
-            list_add(g_lru, pg);
-        } else pg->ref = true; // CLOCK-M marca referencia
-        free(k);
-        return pg;
-    }
+// ====== LRU y frames libres ======
+// Lista doblemente enlazada dentro de cada página: mover al final en un hit,
+// sacar la víctima o soltar una página son O(1). Los frames libres se apilan.
 
-    // Miss: cargar (si hay frame libre, usar; si no, elegir víctima)
-    log_miss(qid, f,t,p);
+static void lru_quitar(t_page* pg){
+    if(!pg->lru_ant && g_lru != pg) return; // no está en la lista
+    if(pg->lru_ant) pg->lru_ant->lru_sig = pg->lru_sig;
+    else g_lru = pg->lru_sig;
+    if(pg->lru_sig) pg->lru_sig->lru_ant = pg->lru_ant;
+    else g_lru_fin = pg->lru_ant;
+    pg->lru_ant = pg->lru_sig = NULL;
+}
 
-    int frame_libre = -1;
-    for(int i=0;i<g_frames;i++) if(!g_by_frame[i]) { frame_libre=i; break; }
+static void lru_al_final(t_page* pg){
+    lru_quitar(pg);
+    pg->lru_ant = g_lru_fin;
+    if(g_lru_fin) g_lru_fin->lru_sig = pg;
+    else g_lru = pg;
+    g_lru_fin = pg;
+}
 
-    if(frame_libre == -1){
-        // elegir víctima
-        if(g_algo==REEMPLAZO_LRU){
-            // víctima = cabeza de la lista
-            t_page* vic = list_remove(g_lru, 0);
-            frame_libre = vic->frame;
+static void frame_liberar(int frame){
+    g_by_frame[frame] = NULL;
+    g_libres[g_libres_n++] = frame;
+}
 
-            if(vic->dirty){
-                // flush de la víctima a Storage
-                storage_put_block(vic->file, vic->tag, vic->page,
-                                  g_mem + frame_offset(frame_libre), g_page_size);
-            }
-            log_reemplazo(qid, vic->file, vic->tag, vic->page, f,t,p);
-            dictionary_remove_and_destroy(g_ptable, key_ftp(vic->file,vic->tag,vic->page), free);
-            log_free_frame(qid, frame_libre, vic->file, vic->tag);
-            free(vic->file); free(vic->tag); free(vic);
-            g_by_frame[frame_libre]=NULL;
+// Cómo conseguir un frame: esperando si todo está en uso, sin esperar, o
+// (lectura adelantada) sólo uno libre o una víctima limpia, sin tocar los
+// bits de referencia de CLOCK-M ni bajar nada a Storage
+typedef enum { FRAME_ESPERAR, FRAME_SIN_ESPERAR, FRAME_LIMPIO } t_modo_frame;
+
+#define BUSQUEDA_LIMPIA_MAX 64  // candidatas que mira FRAME_LIMPIO antes de rendirse
+
+static t_page* victima_limpia(void){
+    int vistas = 0;
+    if(g_algo==REEMPLAZO_LRU){
+        for(t_page* cand = g_lru; cand && vistas < BUSQUEDA_LIMPIA_MAX; cand = cand->lru_sig, ++vistas)
+            if(!cand->pins && !cand->cargando && !cand->dirty) return cand;
+        return NULL;
+    }
+    for(int i=g_clk_hand; vistas < BUSQUEDA_LIMPIA_MAX && vistas < g_frames; i = (i+1)%g_frames, ++vistas){
+        t_page* cand = g_by_frame[i];
+        if(cand && !cand->pins && !cand->cargando && !cand->dirty && !cand->ref) return cand;
+    }
+    return NULL;
+}
+
+// Con m_mem tomado. Devuelve un frame libre o el de una víctima sin pines;
+// la víctima sale de LRU y queda en la tabla marcada `cargando` (*out_vic)
+// hasta que quien llama la baje a Storage. Si todo está en uso espera
+// (FRAME_ESPERAR) o devuelve -1.
+static int tomar_frame(t_page** out_vic, t_modo_frame modo){
+    *out_vic = NULL;
+    for(;;){
+        if(g_libres_n) return g_libres[--g_libres_n];
+
+        t_page* vic = NULL;
+        if(modo==FRAME_LIMPIO){
+            vic = victima_limpia();
+        } else if(g_algo==REEMPLAZO_LRU){
+            // víctima = la menos reciente que no esté en uso (las pineadas
+            // son a lo sumo una por slot, así que se saltean pocas)
+            for(t_page* cand = g_lru; cand && !vic; cand = cand->lru_sig)
+                if(!cand->pins && !cand->cargando) vic = cand;
         } else {
-            // CLOCK-M
-            while(1){
-                if(!g_by_frame[g_clk_hand]) { frame_libre = g_clk_hand; break; }
+            // CLOCK-M: dos vueltas alcanzan para encontrar una sin ref si la hay
+            for(int n=0; n<2*g_frames && !vic; ++n){
                 t_page* cand = g_by_frame[g_clk_hand];
-                if(cand->ref){ cand->ref=false; g_clk_hand = (g_clk_hand+1)%g_frames; continue; }
-                // víctima
-                t_page* vic = cand; frame_libre = vic->frame;
-                if(vic->dirty){
-                    storage_put_block(vic->file, vic->tag, vic->page,
-                                      g_mem + frame_offset(frame_libre), g_page_size);
-                }
-                log_reemplazo(qid, vic->file, vic->tag, vic->page, f,t,p);
-                // quitar de LRU si estuviera
-                for(int i=0;i<list_size(g_lru);++i) if(list_get(g_lru,i)==vic){ list_remove(g_lru,i); break; }
-                dictionary_remove_and_destroy(g_ptable, key_ftp(vic->file,vic->tag,vic->page), free);
-                log_free_frame(qid, frame_libre, vic->file, vic->tag);
-                free(vic->file); free(vic->tag); free(vic);
-                g_by_frame[frame_libre]=NULL;
                 g_clk_hand = (g_clk_hand+1)%g_frames;
-                break;
+                if(cand->pins || cand->cargando) continue;
+                if(cand->ref){ cand->ref=false; continue; }
+                vic = cand;
             }
         }
+        if(vic){
+            lru_quitar(vic);
+            vic->cargando = true;
+            *out_vic = vic;
+            return vic->frame;
+        }
+        if(modo!=FRAME_ESPERAR) return -1;
+        pthread_cond_wait(&c_mem, &m_mem);
     }
+}
 
-    // cargar desde Storage
-    char* data = storage_get_block(f,t,p);
-    if(!data){ // si Storage no tiene, trae cero
-        data = calloc(g_page_size,1);
+// Con m_mem tomado: frame para `pg` (ya en la tabla, en tránsito). Si hay frame
+// libre se usa; si no se elige víctima, que se baja a Storage si estaba dirty
+// (soltando el lock) y se libera. Si Storage rechaza la víctima, se queda en
+// memoria, dirty, y se sigue buscando sólo entre frames libres y víctimas
+// limpias. -1 si según `modo` no hay ninguno a mano.
+static int asignar_frame(uint32_t qid, t_page* pg, t_modo_frame modo){
+    for(;;){
+        t_page* vic;
+        int frame = tomar_frame(&vic, modo);
+        if(frame < 0) return -1;
+        if(vic){
+            const char* vf = g_ft[vic->ft].file; const char* vt = g_ft[vic->ft].tag; // no se liberan
+            if(vic->dirty){
+                // flush de la víctima a Storage (el frame sigue siendo suyo hasta que confirme)
+                g_ft[vic->ft].n_bajando++;
+                pthread_mutex_unlock(&m_mem);
+                int st = storage_put_block(vf, vt, vic->page, g_mem + frame_offset(frame), g_page_size);
+                pthread_mutex_lock(&m_mem);
+                g_ft[vic->ft].n_bajando--;
+                if(st != 0){
+                    log_error(g_wlogger, "Query %u: no se pudo bajar la víctima %s:%s/%u a Storage, sigue en memoria", qid, vf, vt, vic->page);
+                    vic->cargando = false;
+                    if(g_algo==REEMPLAZO_LRU) lru_al_final(vic);
+                    pthread_cond_broadcast(&c_mem);
+                    modo = FRAME_LIMPIO;
+                    continue;
+                }
+            }
+            log_reemplazo(qid, vf, vt, vic->page, g_ft[pg->ft].file, g_ft[pg->ft].tag, pg->page);
+            pt_quitar(vic);
+            log_free_frame(qid, frame, vf, vt);
+            free(vic);
+            pthread_cond_broadcast(&c_mem);
+        }
+        pg->frame = frame;
+        g_by_frame[frame] = pg;
+        return frame;
     }
-    memcpy(g_mem + frame_offset(frame_libre), data, g_page_size);
-    free(data);
+}
 
-    // crear page
+// buscar o cargar página; retorna t_page* pineada (soltar con unpin) y aplica
+// logs/miss/add/asignación. `ft` es el id de f:t; `pre` (opcional) es el
+// contenido con el que entra si falta (una escritura que la pisa entera).
+// NULL si no hubo frame: las víctimas dirty no se pudieron bajar a Storage.
+// Para escribir espera a que termine un flush en curso de esa página.
+static t_page* ensure_page_con(uint32_t qid, uint32_t ft, const char* f, const char* t, uint32_t p, const char* pre, bool escribir){
+    pthread_mutex_lock(&m_mem);
+    t_page* pg;
+    while((pg = pt_get(ft, p)) && (pg->cargando || (escribir && pg->bajando)))
+        pthread_cond_wait(&c_mem, &m_mem);
+    g_accesos++;
+    worker_exec_avance();
+    if(pg){
+        if(pg->adelantada){ pg->adelantada = false; g_ra_n--; }
+        // LRU: mover a cola
+        if(g_algo==REEMPLAZO_LRU) lru_al_final(pg);
+        else pg->ref = true; // CLOCK-M marca referencia
+        pg->pins++;
+        if(escribir) pg->escritores++;
+        pthread_mutex_unlock(&m_mem);
+        return pg;
+    }
+
+    // Miss: la página entra a la tabla ya en tránsito, así otro que la pida
+    // espera en vez de traerla dos veces
+    log_miss(qid, f,t,p);
+    g_misses++;
     pg = calloc(1,sizeof(*pg));
-    pg->file=strdup(f); pg->tag=strdup(t); pg->page=p; pg->dirty=false; pg->ref=true; pg->frame=frame_libre;
-    g_by_frame[frame_libre] = pg;
-    dictionary_put(g_ptable, key_ftp(f,t,p), pg);
-    if(g_algo==REEMPLAZO_LRU) list_add(g_lru, pg);
+    pg->ft=ft; pg->page=p; pg->ref=true; pg->frame=-1;
+    pg->cargando=true;
+    pt_put(pg);
 
-    log_assign(qid, frame_libre, f,t,p);
-    log_add(qid, f,t,p, frame_libre);
+    int frame = asignar_frame(qid, pg, FRAME_ESPERAR);
+    if(frame < 0){
+        pt_quitar(pg);
+        free(pg);
+        pthread_cond_broadcast(&c_mem);
+        pthread_mutex_unlock(&m_mem);
+        return NULL;
+    }
+    pthread_mutex_unlock(&m_mem);
+
+    // cargar desde Storage
+    if(pre){
+        memcpy(g_mem + frame_offset(frame), pre, g_page_size);
+    } else {
+        char* data = storage_get_block(f,t,p);
+        if(!data){ // si Storage no tiene, trae cero
+            data = calloc(g_page_size,1);
+        }
+        memcpy(g_mem + frame_offset(frame), data, g_page_size);
+        free(data);
+    }
+
+    pthread_mutex_lock(&m_mem);
+    pg->cargando = false;
+    pg->pins = 1;
+    pg->escritores = escribir ? 1 : 0;
+    if(g_algo==REEMPLAZO_LRU) lru_al_final(pg);
+    log_assign(qid, frame, f,t,p);
+    log_add(qid, f,t,p, frame);
+    pthread_cond_broadcast(&c_mem);
+    pthread_mutex_unlock(&m_mem);
     return pg;
 }
 
+// fin del acceso a una página pineada; `escrita` la deja dirty
+static void unpin(t_page* pg, bool escrita){
+    pthread_mutex_lock(&m_mem);
+    if(escrita){ pg->escritores--; sucia_marcar(pg); }
+    if(--pg->pins == 0) pthread_cond_broadcast(&c_mem);
+    pthread_mutex_unlock(&m_mem);
+}
+
+// ====== Pedidos por lote ======
+// Las páginas de un lote entran a la tabla en tránsito (`cargando`) y con frame
+// antes de pedirlas, igual que en un miss: quien las busque espera en vez de
+// traerlas por su cuenta, y nadie puede cargar, escribir ni bajar otra copia
+// mientras el lote viaja.
+
+// Con m_mem tomado (puede soltarse si una víctima dirty se baja a Storage).
+// Reserva las páginas de [desde,hasta) que no están, a lo sumo `max`, con
+// frames según `modo`; se corta en la primera que no consigue frame. Las del
+// propio acceso (`adelantada` en false) cuentan y se loguean como miss.
+static uint32_t reservar_paginas(uint32_t qid, uint32_t ft, uint32_t desde, uint32_t hasta, uint32_t max,
+                                 t_modo_frame modo, bool adelantada, uint32_t* pages, t_page** pgs){
+    uint32_t n = 0;
+    for(uint32_t p = desde; p < hasta && n < max; ++p){
+        if(pt_get(ft, p)) continue;
+        t_page* pg = calloc(1,sizeof(*pg));
+        pg->ft=ft; pg->page=p; pg->frame=-1;
+        pg->ref = !adelantada;
+        pg->cargando=true;
+        if(adelantada){ pg->adelantada=true; g_ra_n++; }
+        pt_put(pg);
+        if(asignar_frame(qid, pg, modo) < 0){ pt_quitar(pg); free(pg); break; }
+        if(!adelantada){ log_miss(qid, g_ft[ft].file, g_ft[ft].tag, p); g_misses++; }
+        pages[n] = p; pgs[n] = pg; n++;
+    }
+    return n;
+}
+
+// Con m_mem tomado: la página reservada `pg` ya tiene su contenido en el
+// frame, o no se pudo traer y se suelta
+static void reservada_lista(uint32_t qid, t_page* pg, bool ok){
+    int frame = pg->frame;
+    if(!ok){
+        pt_quitar(pg);
+        free(pg);
+        frame_liberar(frame);
+        return;
+    }
+    pg->cargando = false;
+    if(g_algo==REEMPLAZO_LRU) lru_al_final(pg);
+    log_assign(qid, frame, g_ft[pg->ft].file, g_ft[pg->ft].tag, pg->page);
+    log_add(qid, g_ft[pg->ft].file, g_ft[pg->ft].tag, pg->page, frame);
+}
+
+// Con m_mem tomado (se suelta durante la E/S). Trae las n páginas reservadas
+// en un pedido por lote directo a sus frames; si Storage lo rechaza (p. ej.
+// pasa el fin del archivo) se piden de a una hasta la primera que falte.
+// Las que no llegan se sueltan. Devuelve cuántas llegaron (son las primeras).
+static uint32_t traer_reservadas(uint32_t qid, uint32_t ft, uint32_t n, const uint32_t* pages, t_page** pgs){
+    const char* f = g_ft[ft].file; const char* t = g_ft[ft].tag; // no se liberan
+    pthread_mutex_unlock(&m_mem);
+    char* datos = malloc((size_t)n * g_page_size);
+    uint32_t ok = 0;
+    if(storage_get_blocks_esperar(storage_get_blocks_async(f,t,n,pages), n, datos) == 0){
+        for(uint32_t i=0;i<n;i++) memcpy(g_mem + frame_offset(pgs[i]->frame), datos + (size_t)i * g_page_size, g_page_size);
+        ok = n;
+    } else {
+        for(; ok<n; ++ok){
+            char* b = storage_get_block(f, t, pages[ok]);
+            if(!b) break;
+            memcpy(g_mem + frame_offset(pgs[ok]->frame), b, g_page_size);
+            free(b);
+        }
+    }
+    free(datos);
+    pthread_mutex_lock(&m_mem);
+    for(uint32_t i=0;i<n;i++) reservada_lista(qid, pgs[i], i < ok);
+    pthread_cond_broadcast(&c_mem);
+    return ok;
+}
+
+// Trae en un solo pedido las páginas de [first,last] que no están en memoria
+// (a lo sumo g_frames, para no desalojar lo que se acaba de traer). Toma
+// frames sin esperar: las que no consiguen, o no llegan, las trae después
+// el camino de a una.
+static void prefetch_rango(uint32_t qid, uint32_t ft, uint32_t first, uint32_t last){
+    uint32_t cap = last - first + 1;
+    if(cap > (uint32_t)g_frames) cap = (uint32_t)g_frames;
+    if(cap > g_lote_max) cap = g_lote_max;
+    if(cap < 2) return;
+    uint32_t* pages = malloc(sizeof(uint32_t) * cap);
+    t_page** pgs = malloc(sizeof(t_page*) * cap);
+    pthread_mutex_lock(&m_mem);
+    uint32_t n = reservar_paginas(qid, ft, first, last + 1, cap, FRAME_SIN_ESPERAR, false, pages, pgs);
+    if(n > 0) traer_reservadas(qid, ft, n, pages, pgs);
+    pthread_mutex_unlock(&m_mem);
+    free(pages); free(pgs);
+}
+
+// ====== Lectura adelantada ======
+
+// Con m_mem tomado (se suelta durante la E/S). Reserva frames para las páginas
+// de la ventana que no están, sólo libres o de víctimas limpias: no espera ni
+// baja nada a Storage, y no desaloja lo que la Query acaba de escribir. Si
+// algunas no llegan (la ventana pasa el fin del archivo), desde la primera
+// que faltó se vuelve a pedir en la próxima lectura secuencial.
+static void traer_adelantadas(t_adelanto* a){
+    uint32_t* pages = malloc(sizeof(uint32_t) * (a->hasta - a->desde));
+    t_page** pgs = malloc(sizeof(t_page*) * (a->hasta - a->desde));
+    uint32_t n = g_ra_n >= g_ra_max ? 0 : reservar_paginas(a->qid, a->ft, a->desde, a->hasta, g_ra_max - g_ra_n,
+                                  FRAME_LIMPIO, true, pages, pgs);
+    if(n > 0){
+        uint32_t ok = traer_reservadas(a->qid, a->ft, n, pages, pgs);
+        if(ok < n && g_ft[a->ft].ra_hasta > pages[ok]) g_ft[a->ft].ra_hasta = pages[ok];
+        log_debug(g_wlogger, "Query %u: Lectura adelantada de %s:%s páginas %u a %u: %u traídas",
+                  a->qid, g_ft[a->ft].file, g_ft[a->ft].tag, pages[0], pages[n-1], ok);
+    }
+    free(pages); free(pgs);
+}
+
+static void* adelanto_thread(void* _){
+    (void)_;
+    pthread_mutex_lock(&m_mem);
+    for(;;){
+        while(list_is_empty(g_adelantos)) pthread_cond_wait(&c_adelanto, &m_mem);
+        t_adelanto* a = list_remove(g_adelantos, 0);
+        traer_adelantadas(a);
+        free(a);
+    }
+    return NULL;
+}
+
+// Una lectura de varias páginas, o que sigue a la anterior del mismo file:tag,
+// es secuencial: se encola la ventana que viene después (lo no pedido todavía)
+static void adelantar(uint32_t qid, uint32_t ft, uint32_t first, uint32_t last){
+    if(!g_ra_ventana) return;
+    pthread_mutex_lock(&m_mem);
+    t_filetag* e = &g_ft[ft];
+    bool secuencial = last > first || (e->ra_sig && (first == e->ra_sig || first + 1 == e->ra_sig));
+    e->ra_sig = last + 1;
+    uint32_t desde = last + 1, hasta = last + 1 + g_ra_ventana;
+    if(e->ra_hasta > desde && e->ra_hasta <= hasta) desde = e->ra_hasta;
+    if(secuencial && desde < hasta){
+        t_adelanto* a = malloc(sizeof(*a));
+        *a = (t_adelanto){ qid, ft, desde, hasta };
+        list_add(g_adelantos, a);
+        e->ra_hasta = hasta;
+        pthread_cond_signal(&c_adelanto);
+    }
+    pthread_mutex_unlock(&m_mem);
+}
+
+// ventana en páginas (0 = sin lectura adelantada); max_frames 0 = un cuarto de la memoria
+void mem_adelanto_iniciar(uint32_t ventana, uint32_t max_frames){
+    if(ventana == 0) return;
+    if(max_frames == 0) max_frames = (uint32_t)g_frames / 4;
+    if(max_frames > (uint32_t)g_frames / 2) max_frames = (uint32_t)g_frames / 2; // que siempre quede lugar para las Queries
+    if(max_frames == 0) return;
+    if(ventana > g_lote_max) ventana = g_lote_max; // la ventana viaja en un solo lote
+    g_ra_ventana = ventana;
+    g_ra_max = max_frames;
+    g_adelantos = list_create();
+    pthread_t t; pthread_create(&t, NULL, adelanto_thread, NULL); pthread_detach(t);
+    log_info(g_wlogger, "Lectura adelantada: ventana de %u páginas, hasta %u frames", ventana, max_frames);
+}
+
 char* mem_read(uint32_t qid, const char* f, const char* t, size_t base, size_t size){
     size_t remaining = size, cursor = base;
     char* out = calloc(size+1,1);
     size_t out_off = 0;
 
+    uint32_t ft = (uint32_t)ft_id_lock(f, t, true);
+    if(size){
+        uint32_t first = (uint32_t)(base/g_page_size), last = (uint32_t)((base+size-1)/g_page_size);
+        adelantar(qid, ft, first, last); // la ventana siguiente viaja mientras se lee ésta
+        prefetch_rango(qid, ft, first, last);
+    }
+
     while(remaining > 0){
         uint32_t page = (uint32_t)(cursor / g_page_size);
         size_t   in_page_off = cursor % g_page_size;
         size_t   chunk = g_page_size - in_page_off;
         if(chunk > remaining) chunk = remaining;
 
-        t_page* pg = ensure_page(qid, f,t,page);
+        t_page* pg = ensure_page_con(qid, ft, f,t,page, NULL, false);
+        if(!pg){ free(out); return NULL; }
         mem_delay();
 
         // leer
@@ -177,9 +671,8 @@ char* mem_read(uint32_t qid, const char* f, const char* t, size_t base, size_t s
         memcpy(out + out_off, g_mem + phy, chunk);
 
         // log de acceso a memoria (muestra el fragmento leído)
-        char* frag = strndup(out + out_off, (chunk>32)?32:chunk);
-        log_mem_rw(qid, "LEER", phy, frag);
-        free(frag);
+        log_mem_rw(qid, "LEER", phy, out + out_off, chunk);
+        unpin(pg, false);
 
         out_off += chunk; cursor += chunk; remaining -= chunk;
     }
@@ -189,6 +682,7 @@ char* mem_read(uint32_t qid, const char* f, const char* t, size_t base, size_t s
 int mem_write(uint32_t qid, const char* f, const char* t, size_t base, const char* data, size_t len){
     size_t remaining = len, cursor = base;
     size_t src_off = 0;
+    uint32_t ft = (uint32_t)ft_id_lock(f, t, true);
 
     while(remaining > 0){
         uint32_t page = (uint32_t)(cursor / g_page_size);
@@ -196,33 +690,88 @@ int mem_write(uint32_t qid, const char* f, const char* t, size_t base, const cha
         size_t   chunk = g_page_size - in_page_off;
         if(chunk > remaining) chunk = remaining;
 
-        t_page* pg = ensure_page(qid, f,t,page);
+        // una página que se pisa entera no se trae de Storage: entra con lo escrito
+        const char* entera = (in_page_off == 0 && chunk == g_page_size) ? data + src_off : NULL;
+        t_page* pg = ensure_page_con(qid, ft, f,t,page, entera, true);
+        if(!pg) return -1;
         mem_delay();
 
         size_t phy = (size_t)frame_offset(pg->frame) + in_page_off;
         memcpy(g_mem + phy, data + src_off, chunk);
-        pg->dirty = true;
 
-        char* frag = strndup(data + src_off, (chunk>32)?32:chunk);
-        log_mem_rw(qid, "ESCRIBIR", phy, frag);
-        free(frag);
+        log_mem_rw(qid, "ESCRIBIR", phy, data + src_off, chunk);
+        unpin(pg, true);
 
         src_off += chunk; cursor += chunk; remaining -= chunk;
     }
     return 0;
 }
 
-void mem_flush_file(uint32_t qid, const char* f, const char* t){
-    // recorrer todos los frames y escribir los dirty que coincidan con file:tag
-    for(int i=0;i<g_frames;i++){
-        t_page* pg = g_by_frame[i];
-        if(!pg) continue;
-        if(strcmp(pg->file,f)==0 && strcmp(pg->tag,t)==0 && pg->dirty){
-            storage_put_block(pg->file, pg->tag, pg->page, g_mem + frame_offset(i), g_page_size);
-            pg->dirty=false;
+// Con m_mem tomado (se suelta durante la E/S). Junta hasta `max` dirty de
+// file:tag y los manda en un único STORAGE_PUT_BLOCKS; cada bloque sale directo
+// de su frame, pineado y marcado `bajando` para que nadie lo escriba mientras
+// viaja. Una página con una escritura en curso no se toma: el flusher la
+// saltea y un flush explícito (`esperar`) espera a que termine. Las páginas
+// siguen dirty hasta que Storage confirma. Devuelve cuántas bajó o -1 si
+// Storage rechazó el lote (quedan dirty para el próximo intento).
+static int bajar_sucias(uint32_t ft, uint32_t max, bool esperar){
+    for(bool ocupada = esperar; ocupada; ){
+        ocupada = false;
+        for(t_page* pg = g_ft[ft].sucias; pg && !ocupada; pg = pg->suc_sig)
+            if(pg->escritores) ocupada = true;
+        if(ocupada) pthread_cond_wait(&c_mem, &m_mem);
+    }
+    uint32_t cap = g_ft[ft].n_sucias < max ? g_ft[ft].n_sucias : max;
+    if(cap > g_lote_max) cap = g_lote_max;
+    if(cap == 0) return 0;
+    uint32_t* pages = malloc(sizeof(uint32_t) * cap);
+    const char** datas = malloc(sizeof(char*) * cap);
+    t_page** pgs = malloc(sizeof(t_page*) * cap);
+    uint32_t n = 0;
+    for(t_page* pg = g_ft[ft].sucias; pg && n < cap; pg = pg->suc_sig){
+        if(pg->cargando || pg->bajando || pg->escritores) continue; // víctima: la baja quien la desalojó
+        pages[n] = pg->page; datas[n] = g_mem + frame_offset(pg->frame); pgs[n] = pg; n++;
+        pg->pins++;
+        pg->bajando = true;
+    }
+    int st = 0;
+    if(n > 0){
+        const char* f = g_ft[ft].file; const char* t = g_ft[ft].tag;
+        g_ft[ft].n_bajando += n;
+        pthread_mutex_unlock(&m_mem);
+        st = storage_put_blocks_esperar(storage_put_blocks_async(f, t, n, pages, datas, g_page_size));
+        pthread_mutex_lock(&m_mem);
+        g_ft[ft].n_bajando -= n;
+        for(uint32_t i=0;i<n;i++){
+            pgs[i]->bajando = false;
+            pgs[i]->pins--;
+            if(st == 0) sucia_limpiar(pgs[i]);
         }
+        if(st != 0) log_error(g_wlogger, "No se pudieron bajar %u páginas de %s:%s a Storage (status %d), siguen dirty", n, f, t, st);
+        pthread_cond_broadcast(&c_mem);
+    }
+    free(pages); free(datas); free(pgs);
+    return st == 0 ? (int)n : -1;
+}
+
+int mem_flush_file(uint32_t qid, const char* f, const char* t){
+    int r = 0;
+    pthread_mutex_lock(&m_mem);
+    int ft = ft_id(f, t, false); // si nunca se usó, no hay nada en memoria
+    // dos pasadas: lo que el flusher o un desalojo tenían en viaje tiene que
+    // llegar antes de que el que llama siga (p. ej. con un COMMIT), y si
+    // Storage se lo rechazó al flusher vuelve a estar dirty para la segunda
+    for(int pasada=0; ft >= 0 && pasada < 2 && r == 0; ++pasada){
+        // de a lotes que entren en un mensaje, mientras alguno baje algo
+        int n;
+        while((n = bajar_sucias((uint32_t)ft, UINT32_MAX, true)) > 0 && g_ft[ft].n_sucias > 0);
+        if(n < 0) r = -1;
+        while(g_ft[ft].n_bajando) pthread_cond_wait(&c_mem, &m_mem);
+        if(g_ft[ft].n_sucias == 0) break;
     }
+    pthread_mutex_unlock(&m_mem);
     (void)qid; // los logs de flush explícito no eran obligatorios, ya logueamos escrituras
+    return r;
 }
 
 void mem_flush_set(uint32_t qid, t_list* touched){
@@ -233,39 +782,120 @@ void mem_flush_set(uint32_t qid, t_list* touched){
         char* sep = strchr(file, ':');
         if(!sep){ free(file); continue; }
         *sep='\0'; char* tag = sep+1;
-        mem_flush_file(qid, file, tag);
+        if(mem_flush_file(qid, file, tag) != 0)
+            log_error(g_wlogger, "Query %u: el flush por desalojo de %s no llegó a Storage", qid, ft);
         free(file);
     }
 }
 
+// Con m_mem tomado: espera a que ninguna página de file:tag (desde first_page)
+// esté pineada o en tránsito y después las suelta.
+static void soltar_paginas(uint32_t qid, const char* f, const char* t, uint32_t first_page){
+    int id = ft_id(f, t, false);
+    if(id < 0) return;
+    uint32_t ft = (uint32_t)id;
+    for(;;){
+        bool ocupada = false;
+        for(t_page* pg = g_ft[ft].residentes; pg && !ocupada; pg = pg->res_sig)
+            if((pg->pins || pg->cargando) && pg->page >= first_page) ocupada = true;
+        if(!ocupada) break;
+        pthread_cond_wait(&c_mem, &m_mem);
+    }
+    for(t_page *pg = g_ft[ft].residentes, *sig; pg; pg = sig){
+        sig = pg->res_sig;
+        if(pg->page < first_page) continue;
+        // quitar de ptable (y de las listas del file:tag) y LRU
+        int frame = pg->frame;
+        lru_quitar(pg);
+        pt_quitar(pg);
+        log_free_frame(qid, frame, f, t);
+        free(pg);
+        frame_liberar(frame);
+    }
+    pthread_cond_broadcast(&c_mem);
+}
+
 void mem_drop_file(const char* f, const char* t){
     // libera frames (sin flush, el que llama decide si flush o no) + LOG obligatorio
-    for(int i=0;i<g_frames;i++){
-        t_page* pg = g_by_frame[i];
-        if(!pg) continue;
-        if(strcmp(pg->file,f)==0 && strcmp(pg->tag,t)==0){
-            // quitar de ptable y LRU
-            for(int j=0;j<list_size(g_lru);++j) if(list_get(g_lru,j)==pg){ list_remove(g_lru,j); break; }
-            dictionary_remove_and_destroy(g_ptable, key_ftp(pg->file,pg->tag,pg->page), free);
-            log_free_frame(0 /*qid no relevante*/, i, pg->file, pg->tag);
-            free(pg->file); free(pg->tag); free(pg);
-            g_by_frame[i]=NULL;
-        }
-    }
+    pthread_mutex_lock(&m_mem);
+    soltar_paginas(0 /*qid no relevante*/, f, t, 0);
+    pthread_mutex_unlock(&m_mem);
 }
 // Invalidar todas las páginas de file:tag con número >= first_page (TRUNCATE que achica)
 void mem_invalidate_from_page(uint32_t qid, const char* f, const char* t, uint32_t first_page){
+    // No se flushea: el Storage ya truncó, estas páginas quedan fuera del nuevo tamaño
+    pthread_mutex_lock(&m_mem);
+    soltar_paginas(qid, f, t, first_page);
+    pthread_mutex_unlock(&m_mem);
+}
+
+// Resumen (Bloom) de los File:Tags con páginas en memoria, para el Master
+void mem_resumen(uint8_t* out){
+    memset(out, 0, RESUMEN_CACHE_BYTES);
+    pthread_mutex_lock(&m_mem);
+    const t_page* ant = NULL;
     for(int i=0;i<g_frames;i++){
         t_page* pg = g_by_frame[i];
         if(!pg) continue;
-        if(strcmp(pg->file,f)==0 && strcmp(pg->tag,t)==0 && pg->page >= first_page){
-            // quitar de estructuras
-            for(int j=0;j<list_size(g_lru);++j) if(list_get(g_lru,j)==pg){ list_remove(g_lru,j); break; }
-            dictionary_remove_and_destroy(g_ptable, key_ftp(pg->file,pg->tag,pg->page), free);
-            // No se flushea: el Storage ya truncó, estas páginas quedan fuera del nuevo tamaño
-            log_free_frame(qid, i, pg->file, pg->tag);
-            free(pg->file); free(pg->tag); free(pg);
-            g_by_frame[i]=NULL;
+        // frames consecutivos suelen ser del mismo File:Tag
+        if(ant && ant->ft==pg->ft) continue;
+        resumen_agregar(out, g_ft[pg->ft].hash);
+        ant = pg;
+    }
+    pthread_mutex_unlock(&m_mem);
+}
+
+// Ocupación de frames y fallos desde el reporte anterior (WORKER_STATUS)
+void mem_estado(t_mem_estado* e){
+    pthread_mutex_lock(&m_mem);
+    e->frames = (uint32_t)g_frames;
+    e->ocupados = (uint32_t)(g_frames - g_libres_n);
+    e->dirty = g_sucias;
+    e->accesos = g_accesos; e->misses = g_misses;
+    g_accesos = g_misses = 0;
+    pthread_mutex_unlock(&m_mem);
+}
+
+// ====== Write-back en segundo plano ======
+// Mantiene pocas páginas dirty para que los desalojos encuentren víctimas
+// limpias y un COMMIT tenga poco que bajar. Recorre los File:Tags por turno y
+// baja de a uno (un solo pedido por lote) sólo el excedente sobre la marca baja.
+static void* flusher_thread(void* _){
+    (void)_;
+    uint32_t turno = 0;
+    pthread_mutex_lock(&m_mem);
+    for(;;){
+        while(g_sucias < g_marca_alta) pthread_cond_wait(&c_flusher, &m_mem);
+        uint32_t bajadas = 0;
+        bool fallo = false;
+        for(uint32_t i=0; i<g_ft_n && g_sucias > g_marca_baja && !fallo; ++i){
+            uint32_t ft = (turno + i) % g_ft_n;
+            int n = bajar_sucias(ft, g_sucias - g_marca_baja, false);
+            if(n < 0) fallo = true;
+            else if(n){ bajadas += (uint32_t)n; turno = ft + 1; }
+        }
+        log_debug(g_wlogger, "Write-back: %u páginas bajadas a Storage, quedan %u dirty", bajadas, g_sucias);
+        if(fallo){
+            // Storage rechazó un lote: reintentar más tarde, sin insistir en seguida
+            pthread_mutex_unlock(&m_mem);
+            usleep(FLUSHER_REINTENTO_MS * 1000);
+            pthread_mutex_lock(&m_mem);
+        } else if(!bajadas && g_sucias >= g_marca_alta){
+            // todo lo que queda está pineado o en tránsito: esperar a que algo cambie
+            pthread_cond_wait(&c_mem, &m_mem);
         }
     }
-}
\ No newline at end of file
+    return NULL;
+}
+
+// marcas en % de los frames; alta 0 = sin flusher
+void mem_writeback_iniciar(uint32_t alta_pct, uint32_t baja_pct){
+    if(alta_pct == 0 || alta_pct > 100) return;
+    if(baja_pct >= alta_pct) baja_pct = alta_pct / 2;
+    g_marca_alta = (uint32_t)(((uint64_t)g_frames * alta_pct + 99) / 100);
+    g_marca_baja = (uint32_t)((uint64_t)g_frames * baja_pct / 100);
+    if(g_marca_alta == 0) g_marca_alta = 1;
+    pthread_t t; pthread_create(&t, NULL, flusher_thread, NULL); pthread_detach(t);
+    log_info(g_wlogger, "Write-back en segundo plano: desde %u hasta %u páginas dirty (de %d)",
+             g_marca_alta, g_marca_baja, g_frames);
+}
@@ -9,83 +9,338 @@ static inline void add_cstring(t_paquete* p, const char* s){
     agregar_a_paquete(p, (void*)s, len);
 }
 static uint32_t read_u32_from_pkg(t_paquete* p){ uint32_t v=0; buffer_read(&v,p->buffer,sizeof(uint32_t)); return v; }
+// bytes que ocupan file y tag serializados con add_cstring
+static inline int filetag_size(const char* file, const char* tag){
+    return 2*(int)sizeof(int) + (int)strlen(file)+1 + (int)strlen(tag)+1;
+}
+
+// -------- Pedidos en vuelo --------
+// Cada pedido lleva un id al principio del payload y Storage lo devuelve en la
+// respuesta: varios hilos (o un mismo hilo con pedidos async) pueden tener
+// pedidos pendientes a la vez sobre g_fd_storage.
+struct t_st_pedido {
+    uint32_t   id;
+    int        op_pedido; // Storage responde con el mismo opcode
+    int        op;        // opcode de la respuesta
+    t_paquete* resp;      // NULL si Storage se cayó
+    bool       listo;
+    pthread_cond_t cv;
+};
+
+static pthread_mutex_t m_pedidos = PTHREAD_MUTEX_INITIALIZER;
+static t_list*  g_pedidos = NULL;   // t_st_pedido* esperando respuesta
+static uint32_t g_next_req = 0;
+static bool     g_storage_caido = false;
+
+// crea el paquete con el id ya cargado y registra el pedido antes de enviarlo
+static t_st_pedido* pedido_crear(op_code op, int capacidad, t_paquete** out_req){
+    t_st_pedido* pd = calloc(1, sizeof(*pd));
+    pd->op_pedido = op;
+    pthread_cond_init(&pd->cv, NULL);
+    pthread_mutex_lock(&m_pedidos);
+    pd->id = g_next_req++;
+    if(g_storage_caido) pd->listo = true;
+    else list_add(g_pedidos, pd);
+    pthread_mutex_unlock(&m_pedidos);
+
+    *out_req = crear_paquete_con_capacidad(op, (int)sizeof(uint32_t) + capacidad);
+    agregar_a_paquete(*out_req, &pd->id, sizeof(uint32_t));
+    return pd;
+}
+
+// bloquea hasta la respuesta; devuelve el paquete (offset después del id) o
+// NULL si Storage se cayó o respondió otra cosa
+// (si espera el hilo de una Query, la espera y la respuesta cuentan para su progreso)
+static t_paquete* pedido_esperar(t_st_pedido* pd){
+    worker_exec_esperando_storage(true);
+    pthread_mutex_lock(&m_pedidos);
+    while(!pd->listo) pthread_cond_wait(&pd->cv, &m_pedidos);
+    pthread_mutex_unlock(&m_pedidos);
+    worker_exec_esperando_storage(false);
+    worker_exec_avance();
+    t_paquete* r = pd->resp;
+    if(r && pd->op != pd->op_pedido){ eliminar_paquete(r); r = NULL; }
+    pthread_cond_destroy(&pd->cv);
+    free(pd);
+    return r;
+}
+
+static void* storage_reader_thread(void* _){
+    (void)_;
+    for(;;){
+        int op = recibir_operacion(g_fd_storage);
+        t_paquete* r = op > 0 ? recibir_paquete(g_fd_storage) : NULL;
+        if(!r) break;
+        r->buffer->offset = 0;
+        uint32_t id = read_u32_from_pkg(r);
+
+        pthread_mutex_lock(&m_pedidos);
+        t_st_pedido* pd = NULL;
+        for(int i=0;i<list_size(g_pedidos);++i){
+            t_st_pedido* c = list_get(g_pedidos,i);
+            if(c->id == id){ pd = list_remove(g_pedidos,i); break; }
+        }
+        if(pd){ pd->op = op; pd->resp = r; pd->listo = true; pthread_cond_signal(&pd->cv); }
+        pthread_mutex_unlock(&m_pedidos);
+        if(!pd){ log_warning(g_wlogger,"Respuesta de Storage sin pedido (id=%u)", id); eliminar_paquete(r); }
+    }
+
+    // Storage cerró: despertar a todos los que esperan con error
+    log_error(g_wlogger,"Se perdió la conexión con Storage");
+    pthread_mutex_lock(&m_pedidos);
+    g_storage_caido = true;
+    for(int i=0;i<list_size(g_pedidos);++i){
+        t_st_pedido* pd = list_get(g_pedidos,i);
+        pd->listo = true; pthread_cond_signal(&pd->cv);
+    }
+    list_clean(g_pedidos);
+    pthread_mutex_unlock(&m_pedidos);
+    return NULL;
+}
+
+// Anillos para hablar con Storage por memoria compartida: sólo si el socket es
+// AF_UNIX (los fds viajan por SCM_RIGHTS). Si no se puede, sigue por socket.
+static bool anillos_crear(uint32_t tam, t_anillo** tx, t_anillo** rx){
+    *tx = *rx = NULL;
+    if(!tam) return false;
+    if(!socket_es_local(g_fd_storage)){
+        log_warning(g_wlogger,"TRANSPORTE_STORAGE=SHM requiere PUERTO_STORAGE con ruta de socket local; sigo por socket");
+        return false;
+    }
+    *tx = anillo_crear(tam); *rx = anillo_crear(tam);
+    if(*tx && *rx) return true;
+    anillo_destruir(*tx); anillo_destruir(*rx); *tx = *rx = NULL;
+    log_warning(g_wlogger,"No pude crear la memoria compartida con Storage; sigo por socket");
+    return false;
+}
 
-int storage_connect_and_handshake(const char* ip, const char* puerto){
+int storage_connect_and_handshake(const char* ip, const char* puerto, uint32_t tam_anillo){
     g_fd_storage = crear_conexion((char*)ip, (char*)puerto);
     if(g_fd_storage < 0) return -1;
 
+    t_anillo *tx, *rx;
     t_paquete* hello = crear_paquete(STORAGE_HANDSHAKE);
-    enviar_paquete(hello, g_fd_storage); eliminar_paquete(hello);
+    if(anillos_crear(tam_anillo, &tx, &rx)){
+        uint32_t pide_shm = 1; agregar_a_paquete(hello, &pide_shm, sizeof(uint32_t));
+        int fds[2*ANILLO_FDS]; anillo_fds(tx, fds); anillo_fds(rx, fds + ANILLO_FDS);
+        enviar_paquete_con_fds(hello, fds, 2*ANILLO_FDS, g_fd_storage);
+    } else enviar_paquete(hello, g_fd_storage);
+    eliminar_paquete(hello);
 
     int op = recibir_operacion(g_fd_storage);
-    if(op != STORAGE_BLOCK_SIZE){ t_paquete* d=recibir_paquete(g_fd_storage); if(d) eliminar_paquete(d); return -1; }
+    if(op != STORAGE_BLOCK_SIZE){ t_paquete* d=recibir_paquete(g_fd_storage); if(d) eliminar_paquete(d); anillo_destruir(tx); anillo_destruir(rx); return -1; }
     t_paquete* resp = recibir_paquete(g_fd_storage); resp->buffer->offset = 0;
-    buffer_read(&g_block_size, resp->buffer, sizeof(uint32_t)); eliminar_paquete(resp);
+    buffer_read(&g_block_size, resp->buffer, sizeof(uint32_t));
+    uint32_t shm_ok = 0;
+    if(resp->buffer->size >= 2*(int)sizeof(uint32_t)) buffer_read(&shm_ok, resp->buffer, sizeof(uint32_t));
+    eliminar_paquete(resp);
+
+    // desde acá (y antes de cualquier otro pedido) todo va por los anillos
+    if(tx && shm_ok){
+        conexion_adjuntar_anillos(conexion_de(g_fd_storage), rx, tx);
+        log_info(g_wlogger,"Storage por memoria compartida (anillos de %u bytes)", tam_anillo);
+    } else { anillo_destruir(tx); anillo_destruir(rx); }
+
+    // a partir de acá todas las respuestas las reparte el hilo lector
+    g_pedidos = list_create();
+    pthread_t th; pthread_create(&th, NULL, storage_reader_thread, NULL); pthread_detach(th);
 
     log_info(g_wlogger,"Storage conectado. BLOCK_SIZE=%u", g_block_size);
     return g_fd_storage;
 }
 
-int storage_create(const char* file, const char* tag){
-    t_paquete* req = crear_paquete(STORAGE_CREATE); add_cstring(req,file); add_cstring(req,tag);
+// pedidos que sólo responden un status uint32
+static int storage_esperar_status_op(t_st_pedido* pd){
+    t_paquete* r = pedido_esperar(pd);
+    if(!r) return -1;
+    uint32_t st=read_u32_from_pkg(r); eliminar_paquete(r); return (int)st;
+}
+static int storage_filetag_op(op_code op, const char* file, const char* tag){
+    t_paquete* req; t_st_pedido* pd = pedido_crear(op, filetag_size(file,tag), &req);
+    add_cstring(req,file); add_cstring(req,tag);
     enviar_paquete(req,g_fd_storage); eliminar_paquete(req);
-    int op=recibir_operacion(g_fd_storage); t_paquete* r=recibir_paquete(g_fd_storage);
-    if(op!=STORAGE_CREATE){ if(r) eliminar_paquete(r); return -1; }
-    r->buffer->offset=0; uint32_t st=read_u32_from_pkg(r); eliminar_paquete(r); return (int)st;
+    return storage_esperar_status_op(pd);
+}
+
+// -------- Handles --------
+// El tráfico de bloques va por handle (STORAGE_OPEN): Storage resuelve rutas y
+// metadata una sola vez y cada pedido sólo lleva handle + números de bloque.
+// El OPEN viaja sin m_handles tomado: la entrada queda ABRIENDO y los demás
+// hilos que pidan la misma clave esperan en c_handles. Un OPEN fallido
+// también se recuerda (FALLIDO) para no repetir la ida y vuelta en cada pedido;
+// CREATE/TAG sobre esa clave la olvidan.
+typedef enum { HANDLE_ABRIENDO, HANDLE_ABIERTO, HANDLE_FALLIDO } t_estado_handle;
+typedef struct {
+    t_estado_handle estado;
+    uint32_t        h;
+} t_handle;
+
+static pthread_mutex_t m_handles = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  c_handles = PTHREAD_COND_INITIALIZER;
+static t_dictionary*   g_handles = NULL;   // "file:tag" -> t_handle*
+
+// false si el File:Tag no existe (el pedido va por nombre y Storage informa el error)
+static bool storage_handle(const char* file, const char* tag, uint32_t* h){
+    char* key = string_from_format("%s:%s", file, tag);
+    pthread_mutex_lock(&m_handles);
+    if(!g_handles) g_handles = dictionary_create();
+    t_handle* e;
+    while((e = dictionary_get(g_handles, key)) && e->estado == HANDLE_ABRIENDO)
+        pthread_cond_wait(&c_handles, &m_handles);
+    if(e){
+        bool ok = e->estado == HANDLE_ABIERTO;
+        if(ok) *h = e->h;
+        pthread_mutex_unlock(&m_handles); free(key);
+        return ok;
+    }
+    e = calloc(1, sizeof(t_handle));
+    e->estado = HANDLE_ABRIENDO;
+    dictionary_put(g_handles, key, e);
+    pthread_mutex_unlock(&m_handles);
+
+    t_paquete* req; t_st_pedido* pd = pedido_crear(STORAGE_OPEN, filetag_size(file,tag), &req);
+    add_cstring(req,file); add_cstring(req,tag);
+    enviar_paquete(req,g_fd_storage); eliminar_paquete(req);
+    t_paquete* r = pedido_esperar(pd);
+    uint32_t st = 1, nh = 0;
+    if(r){ st = read_u32_from_pkg(r); nh = read_u32_from_pkg(r); eliminar_paquete(r); }
+
+    pthread_mutex_lock(&m_handles);
+    if(!r){
+        // se cayó Storage: no hay nada que recordar
+        dictionary_remove(g_handles, key); free(e);
+    } else if(st==0){
+        e->estado = HANDLE_ABIERTO; e->h = nh; *h = nh;
+    } else e->estado = HANDLE_FALLIDO;
+    pthread_cond_broadcast(&c_handles);
+    pthread_mutex_unlock(&m_handles);
+    free(key);
+    return r && st==0;
+}
+
+// saca la entrada (esperando un OPEN en curso) y, si había handle, lo cierra en Storage
+static void storage_handle_cerrar(const char* file, const char* tag){
+    char* key = string_from_format("%s:%s", file, tag);
+    pthread_mutex_lock(&m_handles);
+    t_handle* e = NULL;
+    if(g_handles){
+        while((e = dictionary_get(g_handles, key)) && e->estado == HANDLE_ABRIENDO)
+            pthread_cond_wait(&c_handles, &m_handles);
+        if(e) dictionary_remove(g_handles, key);
+    }
+    pthread_mutex_unlock(&m_handles);
+    free(key);
+    if(!e) return;
+    if(e->estado == HANDLE_ABIERTO){
+        t_paquete* req; t_st_pedido* pd = pedido_crear(STORAGE_CLOSE, sizeof(uint32_t), &req);
+        agregar_a_paquete(req, &e->h, sizeof(uint32_t));
+        enviar_paquete(req,g_fd_storage); eliminar_paquete(req);
+        storage_esperar_status_op(pd);
+    }
+    free(e);
+}
+
+// olvida un OPEN fallido: la clave puede existir a partir de ahora
+static void storage_handle_olvidar_fallido(const char* file, const char* tag){
+    char* key = string_from_format("%s:%s", file, tag);
+    pthread_mutex_lock(&m_handles);
+    t_handle* e = g_handles ? dictionary_get(g_handles, key) : NULL;
+    if(e && e->estado == HANDLE_FALLIDO){ dictionary_remove(g_handles, key); free(e); }
+    pthread_mutex_unlock(&m_handles);
+    free(key);
+}
+
+int storage_create(const char* file, const char* tag){
+    int st = storage_filetag_op(STORAGE_CREATE, file, tag);
+    if(st==0) storage_handle_olvidar_fallido(file, tag);
+    return st;
 }
 int storage_truncate(const char* file, const char* tag, uint32_t new_size){
-    t_paquete* req = crear_paquete(STORAGE_TRUNCATE); add_cstring(req,file); add_cstring(req,tag);
+    t_paquete* req; t_st_pedido* pd = pedido_crear(STORAGE_TRUNCATE, filetag_size(file,tag)+sizeof(uint32_t), &req);
+    add_cstring(req,file); add_cstring(req,tag);
     agregar_a_paquete(req,&new_size,sizeof(uint32_t)); enviar_paquete(req,g_fd_storage); eliminar_paquete(req);
-    int op=recibir_operacion(g_fd_storage); t_paquete* r=recibir_paquete(g_fd_storage);
-    if(op!=STORAGE_TRUNCATE){ if(r) eliminar_paquete(r); return -1; }
-    r->buffer->offset=0; uint32_t st=read_u32_from_pkg(r); eliminar_paquete(r); return (int)st;
+    return storage_esperar_status_op(pd);
 }
 int storage_delete(const char* file, const char* tag){
-    t_paquete* req = crear_paquete(STORAGE_DELETE); add_cstring(req,file); add_cstring(req,tag);
-    enviar_paquete(req,g_fd_storage); eliminar_paquete(req);
-    int op=recibir_operacion(g_fd_storage); t_paquete* r=recibir_paquete(g_fd_storage);
-    if(op!=STORAGE_DELETE){ if(r) eliminar_paquete(r); return -1; }
-    r->buffer->offset=0; uint32_t st=read_u32_from_pkg(r); eliminar_paquete(r); return (int)st;
-}
-int storage_commit(const char* file, const char* tag){
-    t_paquete* req = crear_paquete(STORAGE_COMMIT); add_cstring(req,file); add_cstring(req,tag);
-    enviar_paquete(req,g_fd_storage); eliminar_paquete(req);
-    int op=recibir_operacion(g_fd_storage); t_paquete* r=recibir_paquete(g_fd_storage);
-    if(op!=STORAGE_COMMIT){ if(r) eliminar_paquete(r); return -1; }
-    r->buffer->offset=0; uint32_t st=read_u32_from_pkg(r); eliminar_paquete(r); return (int)st;
+    storage_handle_cerrar(file, tag);
+    return storage_filetag_op(STORAGE_DELETE, file, tag);
 }
+int storage_commit(const char* file, const char* tag){ return storage_filetag_op(STORAGE_COMMIT, file, tag); }
 int storage_tag(const char* fsrc, const char* tsrc, const char* fdst, const char* tdst){
-    t_paquete* req = crear_paquete(STORAGE_TAG);
+    t_paquete* req; t_st_pedido* pd = pedido_crear(STORAGE_TAG, filetag_size(fsrc,tsrc)+filetag_size(fdst,tdst), &req);
     add_cstring(req,fsrc); add_cstring(req,tsrc); add_cstring(req,fdst); add_cstring(req,tdst);
     enviar_paquete(req,g_fd_storage); eliminar_paquete(req);
-    int op=recibir_operacion(g_fd_storage); t_paquete* r=recibir_paquete(g_fd_storage);
-    if(op!=STORAGE_TAG){ if(r) eliminar_paquete(r); return -1; }
-    r->buffer->offset=0; uint32_t st=read_u32_from_pkg(r); eliminar_paquete(r); return (int)st;
+    int st = storage_esperar_status_op(pd);
+    if(st==0) storage_handle_olvidar_fallido(fdst, tdst);
+    return st;
 }
 
-// bloques
-char* storage_get_block(const char* file, const char* tag, uint32_t page){
-    t_paquete* req=crear_paquete(STORAGE_GET_BLOCK); add_cstring(req,file); add_cstring(req,tag);
-    agregar_a_paquete(req,&page,sizeof(uint32_t)); enviar_paquete(req,g_fd_storage); eliminar_paquete(req);
-
-    int op=recibir_operacion(g_fd_storage); t_paquete* r=recibir_paquete(g_fd_storage);
-    if(op!=STORAGE_GET_BLOCK){ if(r) eliminar_paquete(r); return NULL; }
-    r->buffer->offset=0;
-    // asumimos el Storage devuelve exactamente BLOCK_SIZE bytes
-    char* data = calloc(g_block_size,1);
-    memcpy(data, r->buffer->stream + r->buffer->offset, g_block_size);
-    eliminar_paquete(r);
+// bloques: los de a uno son lotes de un elemento
+t_st_pedido* storage_get_block_async(const char* file, const char* tag, uint32_t page){
+    return storage_get_blocks_async(file, tag, 1, &page);
+}
+char* storage_get_block_esperar(t_st_pedido* pd){
+    char* data = malloc(g_block_size);
+    if(storage_get_blocks_esperar(pd, 1, data) != 0){ free(data); return NULL; }
     return data; // malloc BLOCK_SIZE
 }
+char* storage_get_block(const char* file, const char* tag, uint32_t page){
+    return storage_get_block_esperar(storage_get_block_async(file, tag, page));
+}
+
+t_st_pedido* storage_put_block_async(const char* file, const char* tag, uint32_t page, const char* data, uint32_t len){
+    return storage_put_blocks_async(file, tag, 1, &page, &data, len);
+}
+int storage_put_block_esperar(t_st_pedido* pd){ return storage_put_blocks_esperar(pd); }
 int storage_put_block(const char* file, const char* tag, uint32_t page, const char* data, uint32_t len){
-    t_paquete* req=crear_paquete(STORAGE_PUT_BLOCK); add_cstring(req,file); add_cstring(req,tag);
-    agregar_a_paquete(req,&page,sizeof(uint32_t));
-    // enviamos len seguido de bytes (para no forzar BLOCK_SIZE exacto)
-    agregar_a_paquete(req,&len,sizeof(uint32_t));
-    agregar_a_paquete(req,(void*)data,len);
+    return storage_put_block_esperar(storage_put_block_async(file, tag, page, data, len));
+}
+
+// lotes: varios bloques lógicos de un mismo File:Tag en un solo pedido.
+// Encabezado: [handle] si hay uno abierto, si no [file][tag] con el opcode por nombre.
+static t_st_pedido* lote_crear(op_code op_nombre, op_code op_handle, const char* file, const char* tag, int extra, t_paquete** req){
+    uint32_t h;
+    if(storage_handle(file, tag, &h)){
+        t_st_pedido* pd = pedido_crear(op_handle, (int)sizeof(uint32_t)+extra, req);
+        agregar_a_paquete(*req, &h, sizeof(uint32_t));
+        return pd;
+    }
+    t_st_pedido* pd = pedido_crear(op_nombre, filetag_size(file,tag)+extra, req);
+    add_cstring(*req,file); add_cstring(*req,tag);
+    return pd;
+}
+
+t_st_pedido* storage_get_blocks_async(const char* file, const char* tag, uint32_t n, const uint32_t* pages){
+    t_paquete* req; t_st_pedido* pd = lote_crear(STORAGE_GET_BLOCKS, STORAGE_GET_BLOCKS_H, file, tag, (int)((n+1)*sizeof(uint32_t)), &req);
+    agregar_a_paquete(req,&n,sizeof(uint32_t));
+    agregar_a_paquete(req,(void*)pages,(int)(n*sizeof(uint32_t)));
     enviar_paquete(req,g_fd_storage); eliminar_paquete(req);
+    return pd;
+}
+// copia los n bloques en `out` (n*BLOCK_SIZE); devuelve el status o -1 si se cayó Storage
+int storage_get_blocks_esperar(t_st_pedido* pd, uint32_t n, char* out){
+    t_paquete* r = pedido_esperar(pd);
+    if(!r) return -1;
+    uint32_t st = read_u32_from_pkg(r);
+    if(st==0){
+        size_t total = (size_t)n * g_block_size;
+        if((size_t)(r->buffer->size - r->buffer->offset) < total){ eliminar_paquete(r); return -1; }
+        memcpy(out, r->buffer->stream + r->buffer->offset, total);
+    }
+    eliminar_paquete(r);
+    return (int)st;
+}
 
-    int op=recibir_operacion(g_fd_storage); t_paquete* r=recibir_paquete(g_fd_storage);
-    if(op!=STORAGE_PUT_BLOCK){ if(r) eliminar_paquete(r); return -1; }
-    r->buffer->offset=0; uint32_t st=read_u32_from_pkg(r); eliminar_paquete(r); return (int)st;
+// cada datas[i] (len bytes) sale directo de su frame, sin armar un buffer intermedio
+t_st_pedido* storage_put_blocks_async(const char* file, const char* tag, uint32_t n, const uint32_t* pages, const char* const* datas, uint32_t len){
+    t_paquete* req; t_st_pedido* pd = lote_crear(STORAGE_PUT_BLOCKS, STORAGE_PUT_BLOCKS_H, file, tag, (int)((n+2)*sizeof(uint32_t)), &req);
+    agregar_a_paquete(req,&n,sizeof(uint32_t));
+    agregar_a_paquete(req,(void*)pages,(int)(n*sizeof(uint32_t)));
+    agregar_a_paquete(req,&len,sizeof(uint32_t));
+    struct iovec* iov = malloc((n?n:1) * sizeof(struct iovec));
+    for(uint32_t i=0;i<n;++i){ iov[i].iov_base = (void*)datas[i]; iov[i].iov_len = len; }
+    enviar_paquete_con_iov(req, iov, (int)n, g_fd_storage); eliminar_paquete(req);
+    free(iov);
+    return pd;
 }
+int storage_put_blocks_esperar(t_st_pedido* pd){ return storage_esperar_status_op(pd); }